@@ -0,0 +1,94 @@
+extends Node3D
+
+# Runs the same content on 1, 2, 4 ... LibretroPlayer sessions side by side and prints how frame rates hold up
+
+@export var root_directory := "D:/Libretro"
+@export var core_name := "snes9x"
+@export var game_path := "E:/Roms/Super Mario World (USA).sfc"
+@export var session_counts : Array[int] = [1, 2, 4, 8, 12, 16, 20]
+@export var warmup_seconds := 3.0
+@export var sample_seconds := 10.0
+# Runs every core in its own sklibretro_host process, compare run_usec and ipc_overhead_usec against an in-process run
+@export var out_of_process := false
+
+var screens : Array[MeshInstance3D] = []
+var players : Array[LibretroPlayer] = []
+
+func _ready():
+	print("sessions | godot fps | core fps min / avg | skipped | dropped | audio underruns | run usec | ipc usec")
+	for count in session_counts:
+		await _spawn(count)
+		await get_tree().create_timer(warmup_seconds).timeout
+		await _sample(count)
+	await _clear()
+	print("benchmark done")
+
+
+func _spawn(count):
+	await _clear()
+
+	var columns = int(ceil(sqrt(count)))
+	for i in range(count):
+		var screen = MeshInstance3D.new()
+		var quad = QuadMesh.new()
+		quad.size = Vector2(1.6, 1.2)
+		screen.mesh = quad
+		screen.position = Vector3((i % columns) * 1.7 - columns * 0.85, (i / columns) * -1.3 + columns * 0.65, 0.0)
+		add_child(screen)
+
+		var player = LibretroPlayer.new()
+		player.input_enabled = false
+		player.SetOutOfProcess(out_of_process)
+		screen.add_child(player)
+		player.StartContent(screen, root_directory, core_name, game_path)
+
+		screens.append(screen)
+		players.append(player)
+
+
+func _clear():
+	# Freeing the player runs its _exit_tree, which waits for that session to unload
+	for screen in screens:
+		screen.queue_free()
+	screens.clear()
+	players.clear()
+	await get_tree().process_frame
+
+
+func _sample(count):
+	var start_frames = []
+	var start_skipped = 0
+	var start_dropped = 0
+	var start_underruns = 0
+	for player in players:
+		var stats = player.GetFrameStats()
+		start_frames.append(stats["frames_run"])
+		start_skipped += stats["skipped_frames"]
+		start_dropped += stats["dropped_frames"]
+		start_underruns += player.GetAudioStats()["underruns"]
+
+	var start_process_frames = Engine.get_process_frames()
+	var start_usec = Time.get_ticks_usec()
+	await get_tree().create_timer(sample_seconds).timeout
+	var elapsed_sec = (Time.get_ticks_usec() - start_usec) / 1000000.0
+
+	var min_fps = INF
+	var total_fps = 0.0
+	var skipped = -start_skipped
+	var dropped = -start_dropped
+	var underruns = -start_underruns
+	var run_usec = 0.0
+	var ipc_usec = 0.0
+	for i in range(players.size()):
+		var stats = players[i].GetFrameStats()
+		var fps = (stats["frames_run"] - start_frames[i]) / elapsed_sec
+		min_fps = min(min_fps, fps)
+		total_fps += fps
+		skipped += stats["skipped_frames"]
+		dropped += stats["dropped_frames"]
+		underruns += players[i].GetAudioStats()["underruns"]
+		run_usec += stats["run_usec"]
+		ipc_usec += stats["ipc_overhead_usec"]
+
+	var godot_fps = (Engine.get_process_frames() - start_process_frames) / elapsed_sec
+	print("%8d | %9.1f | %8.2f / %6.2f | %7d | %7d | %15d | %8.1f | %8.1f" % [count, godot_fps, min_fps, total_fps / max(count, 1), skipped, dropped, underruns, run_usec / max(count, 1), ipc_usec / max(count, 1)])
@@ -0,0 +1,329 @@
+// sklibretro_host: runs one libretro core on behalf of the extension, see RemoteCore
+// Usage: sklibretro_host <channel handles> <core path> <game path> <system directory> <save directory>
+
+#include "../src/RemoteChannel.hpp"
+
+#include <libretro.h>
+#include <gfx/scaler/pixconv.h>
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <dlfcn.h>
+#endif
+
+using namespace SK::Remote;
+
+namespace
+{
+Channel s_channel;
+SharedBlock* s_block = nullptr;
+
+std::string s_system_directory;
+std::string s_save_directory;
+retro_pixel_format s_pixel_format = RETRO_PIXEL_FORMAT_0RGB1555;
+bool s_supports_no_game = false;
+
+struct CoreFunctions
+{
+    decltype(&::retro_set_environment) retro_set_environment = nullptr;
+    decltype(&::retro_set_video_refresh) retro_set_video_refresh = nullptr;
+    decltype(&::retro_set_audio_sample) retro_set_audio_sample = nullptr;
+    decltype(&::retro_set_audio_sample_batch) retro_set_audio_sample_batch = nullptr;
+    decltype(&::retro_set_input_poll) retro_set_input_poll = nullptr;
+    decltype(&::retro_set_input_state) retro_set_input_state = nullptr;
+    decltype(&::retro_init) retro_init = nullptr;
+    decltype(&::retro_deinit) retro_deinit = nullptr;
+    decltype(&::retro_get_system_info) retro_get_system_info = nullptr;
+    decltype(&::retro_get_system_av_info) retro_get_system_av_info = nullptr;
+    decltype(&::retro_reset) retro_reset = nullptr;
+    decltype(&::retro_run) retro_run = nullptr;
+    decltype(&::retro_load_game) retro_load_game = nullptr;
+    decltype(&::retro_unload_game) retro_unload_game = nullptr;
+} s_core;
+
+void* LoadSymbol(void* handle, const char* name)
+{
+#if defined(_WIN32)
+    return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(handle), name));
+#else
+    return dlsym(handle, name);
+#endif
+}
+
+template<typename T>
+bool Resolve(void* handle, T& function, const char* name)
+{
+    function = reinterpret_cast<T>(LoadSymbol(handle, name));
+    if (!function)
+        fprintf(stderr, "[sklibretro_host] Missing core symbol %s\n", name);
+    return function != nullptr;
+}
+
+void LogInterfaceLog(retro_log_level level, const char* fmt, ...)
+{
+    if (level < RETRO_LOG_WARN)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "[sklibretro_host] ");
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+// Only what a software rendered core needs, everything the extension's EnvironmentHandler adds on top is unavailable out of process
+bool EnvironmentCallback(uint32_t cmd, void* data)
+{
+    switch (cmd)
+    {
+    case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+        *static_cast<bool*>(data) = true;
+        return true;
+    case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+    {
+        auto format = *static_cast<const retro_pixel_format*>(data);
+        if (format != RETRO_PIXEL_FORMAT_0RGB1555 && format != RETRO_PIXEL_FORMAT_XRGB8888 && format != RETRO_PIXEL_FORMAT_RGB565)
+            return false;
+        s_pixel_format = format;
+        return true;
+    }
+    case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+        *static_cast<const char**>(data) = s_system_directory.c_str();
+        return true;
+    case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+        *static_cast<const char**>(data) = s_save_directory.c_str();
+        return true;
+    case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME:
+        s_supports_no_game = *static_cast<const bool*>(data);
+        return true;
+    case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+        static_cast<retro_log_callback*>(data)->log = LogInterfaceLog;
+        return true;
+    case RETRO_ENVIRONMENT_GET_INPUT_BITMASKS:
+        return true;
+    case RETRO_ENVIRONMENT_SET_GEOMETRY:
+    {
+        auto geometry = static_cast<const retro_game_geometry*>(data);
+        s_block->base_width = geometry->base_width;
+        s_block->base_height = geometry->base_height;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+void VideoRefreshCallback(const void* data, uint32_t width, uint32_t height, size_t pitch)
+{
+    // A null frame is a dupe, the extension keeps showing the previous one
+    if (!data || data == RETRO_HW_FRAME_BUFFER_VALID || width > s_max_frame_width || height > s_max_frame_height)
+        return;
+
+    // Converted straight into the shared block, which is what the extension uploads from
+    uint8_t* dst = s_block->frame;
+    switch (s_pixel_format)
+    {
+    case RETRO_PIXEL_FORMAT_XRGB8888: conv_argb8888_abgr8888(dst, data, width, height, width * 4, pitch); break;
+    case RETRO_PIXEL_FORMAT_RGB565:   conv_rgb565_abgr8888(dst, data, width, height, width * 4, pitch);   break;
+    default:                          conv_0rgb1555_argb8888(dst, data, width, height, width * 4, pitch); break;
+    }
+
+    s_block->frame_width = width;
+    s_block->frame_height = height;
+    s_block->frame_presented = 1;
+}
+
+size_t AudioSampleBatchCallback(const int16_t* data, size_t frames)
+{
+    size_t space = s_max_audio_frames - s_block->audio_frames;
+    size_t count = frames < space ? frames : space;
+    memcpy(s_block->audio + s_block->audio_frames * 2, data, count * 2 * sizeof(int16_t));
+    s_block->audio_frames += static_cast<uint32_t>(count);
+    return frames;
+}
+
+void AudioSampleCallback(int16_t left, int16_t right)
+{
+    int16_t frame[2] = { left, right };
+    AudioSampleBatchCallback(frame, 1);
+}
+
+void InputPollCallback()
+{
+}
+
+int16_t InputStateCallback(uint32_t port, uint32_t device, uint32_t index, uint32_t id)
+{
+    if (port >= s_max_ports)
+        return 0;
+
+    switch (device & RETRO_DEVICE_MASK)
+    {
+    case RETRO_DEVICE_JOYPAD:
+        if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+            return static_cast<int16_t>(s_block->joypad[port]);
+        return id < 16 ? (s_block->joypad[port] >> id) & 1 : 0;
+    case RETRO_DEVICE_ANALOG:
+        if (index <= RETRO_DEVICE_INDEX_ANALOG_RIGHT && id <= RETRO_DEVICE_ID_ANALOG_Y)
+            return s_block->analog[port][index][id];
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+bool LoadGame(const std::string& game_path, std::vector<unsigned char>& game_buffer)
+{
+    retro_system_info system_info = {};
+    s_core.retro_get_system_info(&system_info);
+
+    retro_game_info game_info = {};
+    if (game_path.empty())
+        return s_supports_no_game && s_core.retro_load_game(&game_info);
+
+    game_info.path = game_path.c_str();
+    if (!system_info.need_fullpath)
+    {
+        std::ifstream file(game_path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+
+        game_buffer.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        if (!file.read(reinterpret_cast<char*>(game_buffer.data()), game_buffer.size()))
+            return false;
+
+        game_info.data = game_buffer.data();
+        game_info.size = game_buffer.size();
+    }
+
+    return s_core.retro_load_game(&game_info);
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 6)
+    {
+        fprintf(stderr, "Usage: sklibretro_host <channel handles> <core path> <game path> <system directory> <save directory>\n");
+        return 2;
+    }
+
+    if (!s_channel.Open(argv[1]))
+    {
+        fprintf(stderr, "[sklibretro_host] Failed to open the shared memory channel\n");
+        return 2;
+    }
+    s_block = s_channel.GetBlock();
+
+    std::string core_path = argv[2];
+    std::string game_path = argv[3];
+    s_system_directory = argv[4];
+    s_save_directory = argv[5];
+
+    auto fail = []
+    {
+        s_block->host_state.store(static_cast<uint32_t>(HostState::Failed), std::memory_order_release);
+        return 1;
+    };
+
+#if defined(_WIN32)
+    void* handle = LoadLibraryA(core_path.c_str());
+#else
+    void* handle = dlopen(core_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+    if (!handle)
+    {
+        fprintf(stderr, "[sklibretro_host] Failed to load core %s\n", core_path.c_str());
+        return fail();
+    }
+
+    bool resolved = Resolve(handle, s_core.retro_set_environment, "retro_set_environment")
+                 && Resolve(handle, s_core.retro_set_video_refresh, "retro_set_video_refresh")
+                 && Resolve(handle, s_core.retro_set_audio_sample, "retro_set_audio_sample")
+                 && Resolve(handle, s_core.retro_set_audio_sample_batch, "retro_set_audio_sample_batch")
+                 && Resolve(handle, s_core.retro_set_input_poll, "retro_set_input_poll")
+                 && Resolve(handle, s_core.retro_set_input_state, "retro_set_input_state")
+                 && Resolve(handle, s_core.retro_init, "retro_init")
+                 && Resolve(handle, s_core.retro_deinit, "retro_deinit")
+                 && Resolve(handle, s_core.retro_get_system_info, "retro_get_system_info")
+                 && Resolve(handle, s_core.retro_get_system_av_info, "retro_get_system_av_info")
+                 && Resolve(handle, s_core.retro_reset, "retro_reset")
+                 && Resolve(handle, s_core.retro_run, "retro_run")
+                 && Resolve(handle, s_core.retro_load_game, "retro_load_game")
+                 && Resolve(handle, s_core.retro_unload_game, "retro_unload_game");
+    if (!resolved)
+        return fail();
+
+    s_core.retro_set_environment(EnvironmentCallback);
+    s_core.retro_set_video_refresh(VideoRefreshCallback);
+    s_core.retro_set_audio_sample(AudioSampleCallback);
+    s_core.retro_set_audio_sample_batch(AudioSampleBatchCallback);
+    s_core.retro_set_input_poll(InputPollCallback);
+    s_core.retro_set_input_state(InputStateCallback);
+    s_core.retro_init();
+
+    std::vector<unsigned char> game_buffer;
+    if (!LoadGame(game_path, game_buffer))
+    {
+        fprintf(stderr, "[sklibretro_host] Failed to load game %s\n", game_path.c_str());
+        s_core.retro_deinit();
+        return fail();
+    }
+
+    retro_system_av_info av_info = {};
+    s_core.retro_get_system_av_info(&av_info);
+    s_block->fps = av_info.timing.fps;
+    s_block->sample_rate = av_info.timing.sample_rate;
+    s_block->base_width = av_info.geometry.base_width;
+    s_block->base_height = av_info.geometry.base_height;
+    s_block->max_width = av_info.geometry.max_width;
+    s_block->max_height = av_info.geometry.max_height;
+    s_block->host_state.store(static_cast<uint32_t>(HostState::Ready), std::memory_order_release);
+
+    uint32_t seq = 0;
+    bool running = true;
+    while (running)
+    {
+        // The extension's Await notices a dead parent long before this matters, the timeout only keeps us from sleeping forever
+        if (!s_channel.WaitRequest(seq + 1, std::chrono::seconds(1)))
+            continue;
+        seq++;
+
+        switch (s_block->request)
+        {
+        case Request::RunFrame:
+        {
+            s_block->frame_presented = 0;
+            s_block->audio_frames = 0;
+
+            auto start = std::chrono::steady_clock::now();
+            s_core.retro_run();
+            s_block->run_usec = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        break;
+        case Request::Reset:
+            s_core.retro_reset();
+            break;
+        case Request::Quit:
+            // Answered only after unloading so the extension doesn't kill us halfway through writing saves
+            s_core.retro_unload_game();
+            s_core.retro_deinit();
+            running = false;
+            break;
+        default:
+            break;
+        }
+
+        s_channel.PostResponse(seq);
+    }
+
+    return 0;
+}
@@ -2,6 +2,13 @@
 
 #include <godot_cpp/variant/vector2.hpp>
 
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cmath>
+
+#include <audio/conversion/s16_to_float.h>
+
 #include "Wrapper.hpp"
 #include "Debug.hpp"
 
@@ -9,21 +16,43 @@ using namespace godot;
 
 namespace SK
 {
+// Single frames from retro_audio_sample_t are staged on the calling thread and pushed as one batch
+static constexpr size_t s_sample_staging_frames = 1024;
+static thread_local int16_t s_sample_staging[s_sample_staging_frames * 2];
+static thread_local size_t s_sample_staging_count = 0;
+
 void AudioHandler::SampleCallback(int16_t left, int16_t right)
 {
-    auto instance = Wrapper::GetInstance();
-    if (!instance)
+    auto audio_handler = Wrapper::GetSession()->audio;
+    if (!audio_handler)
+    {
+        LogError("SampleCallback: No session.");
+        return;
+    }
+
+    // Dropped audio never reaches the staging buffer, so none of it is pushed after dropping ends
+    if (audio_handler->m_drop_audio)
     {
-        LogError("SampleCallback: Null Instance.");
+        audio_handler->m_core_frames.fetch_add(1, std::memory_order_relaxed);
         return;
     }
 
-    if (!instance->m_audio_handler->m_audio_stream_generator_playback.is_valid())
+    s_sample_staging[s_sample_staging_count * 2]     = left;
+    s_sample_staging[s_sample_staging_count * 2 + 1] = right;
+    if (++s_sample_staging_count < s_sample_staging_frames)
         return;
 
-    float l = left / 32768.0f;
-    float r = right / 32768.0f;
-    instance->m_audio_handler->m_audio_stream_generator_playback->push_frame(Vector2(l, r));
+    audio_handler->FlushStagedSamples();
+}
+
+void AudioHandler::FlushStagedSamples()
+{
+    if (s_sample_staging_count == 0)
+        return;
+
+    size_t frames = s_sample_staging_count;
+    s_sample_staging_count = 0;
+    PushFrames(s_sample_staging, frames);
 }
 
 size_t AudioHandler::SampleBatchCallback(const int16_t* data, size_t frames)
@@ -31,55 +60,76 @@ size_t AudioHandler::SampleBatchCallback(const int16_t* data, size_t frames)
     if (!data)
         return frames;
 
-    auto instance = Wrapper::GetInstance();
-    if (!instance)
+    auto audio_handler = Wrapper::GetSession()->audio;
+    if (!audio_handler)
     {
-        LogError("SampleBatchCallback: Null Instance.");
+        LogError("SampleBatchCallback: No session.");
         return frames;
     }
 
-    if (instance->m_audio_handler->m_audio_stream_generator_playback.is_null())
+    if (audio_handler->m_audio_stream_generator_playback.is_null())
         return frames;
 
-    auto available_frames = instance->m_audio_handler->m_audio_stream_generator_playback->get_frames_available();
-
-    if (available_frames > instance->m_audio_handler->m_audio_buffer_total_frames)
-        instance->m_audio_handler->m_audio_buffer_total_frames = available_frames;
-
-    auto total_frames = instance->m_audio_handler->m_audio_buffer_total_frames;
-    uint32_t occupancy_percent = 0;
-    if (total_frames > 0) {
-        occupancy_percent = static_cast<uint32_t>(100.0f * (1.0f - static_cast<float>(available_frames) / static_cast<float>(total_frames)));
-        if (occupancy_percent > 100)
-            occupancy_percent = 100;
-    }
-
-    instance->m_audio_handler->m_audio_buffer_occupancy = occupancy_percent;
-
-    for (size_t i = 0; i < frames; ++i)
-    {
-        float l = data[i * 2]     / 32768.0f;
-        float r = data[i * 2 + 1] / 32768.0f;
-        instance->m_audio_handler->m_audio_stream_generator_playback->push_frame(Vector2(l, r));
-    }
+    // Keep ordering intact for cores that mix both callbacks
+    audio_handler->FlushStagedSamples();
+    audio_handler->PushFrames(data, frames);
 
     return frames;
 }
 
-void AudioHandler::Init(float buffer_capacity_sec, double sample_rate)
+static constexpr float s_max_buffer_capacity_sec = 1.0f;
+static constexpr float s_max_adaptive_scale = 4.0f;
+static constexpr uint32_t s_underrun_windows_to_grow = 3;
+static constexpr uint32_t s_stable_windows_to_shrink = 30;
+static constexpr auto s_fill_sample_interval = std::chrono::milliseconds(10);
+static constexpr double s_rate_control_max_delta = 0.002;
+
+void AudioHandler::Init(float latency_sec, double sample_rate)
 {
-    m_audio_buffer_capacity_sec = buffer_capacity_sec;
+    // The queued audio sits around the target fill, so that is what has to cover the core's minimum latency and one device period
+    float target_fill = Wrapper::GetCurrent()->m_audio_target_fill;
+    float core_minimum_sec = m_minimum_audio_latency / 1000.0f / target_fill;
+    float output_latency_sec = static_cast<float>(AudioServer::get_singleton()->get_output_latency()) / target_fill;
+
+    m_latency_sec = latency_sec;
+    m_minimum_capacity_sec = std::max(core_minimum_sec, output_latency_sec);
+    m_audio_buffer_capacity_sec = GetDesiredCapacitySec();
+    m_fill_scale = 1.0f;
+    m_rate_control_fill = -1.0;
     m_audio_sample_rate = sample_rate;
+    m_audio_buffer_total_frames = 0;
+    m_resize_requested = false;
+    m_underrun_window_start = std::chrono::steady_clock::now();
+    m_underrun_window_skips = 0;
+    m_underrun_windows = 0;
+    m_stable_windows = 0;
+    m_stats_window_pushed_frames = m_pushed_frames;
+    m_stats_window_core_frames = m_core_frames;
+    m_stats_window_queued_frames = 0;
+
+    Log("Audio buffer: " + std::to_string(static_cast<int>(m_audio_buffer_capacity_sec * 1000.0f)) + " ms (requested " + std::to_string(static_cast<int>(latency_sec * 1000.0f)) +
+        " ms, core minimum " + std::to_string(m_minimum_audio_latency) + " ms, adaptive scale " + std::to_string(m_adaptive_scale) + ")");
+
+    convert_s16_to_float_init_simd();
+    InitResampler();
 
     m_audio_stream_generator.instantiate();
-    m_audio_stream_generator->set_mix_rate(m_audio_sample_rate);
+    m_audio_stream_generator->set_mix_rate(m_output_sample_rate);
     m_audio_stream_generator->set_buffer_length(m_audio_buffer_capacity_sec);
 
-    m_audio_stream_player = Wrapper::GetInstance()->m_node->get_node<godot::AudioStreamPlayer>("AudioStreamPlayer");
+    m_audio_stream_player = Wrapper::GetCurrent()->m_node->get_node<godot::AudioStreamPlayer>("AudioStreamPlayer");
+    m_audio_stream_player->stop();
     m_audio_stream_player->set_stream(m_audio_stream_generator);
     m_audio_stream_player->play();
 
     m_audio_stream_generator_playback = m_audio_stream_player->get_stream_playback();
+
+    LoadDspFilter(Wrapper::GetCurrent()->m_audio_dsp_filter_path);
+}
+
+float AudioHandler::GetDesiredCapacitySec() const
+{
+    return std::min(std::max(m_latency_sec * m_adaptive_scale, m_minimum_capacity_sec), s_max_buffer_capacity_sec);
 }
 
 void AudioHandler::DeInit()
@@ -87,7 +137,7 @@ void AudioHandler::DeInit()
     if (m_audio_stream_player)
     {
         m_audio_stream_player->stop();
-        Wrapper::GetInstance()->m_node->remove_child(m_audio_stream_player);
+        Wrapper::GetCurrent()->m_node->remove_child(m_audio_stream_player);
         m_audio_stream_player = nullptr;
     }
 
@@ -99,6 +149,60 @@ void AudioHandler::DeInit()
 
     if (m_audio_stream_generator.is_valid())
         m_audio_stream_generator.unref();
+
+    if (m_dsp_filter)
+    {
+        retro_dsp_filter_free(m_dsp_filter);
+        m_dsp_filter = nullptr;
+    }
+
+    if (m_pending_dsp_filter)
+    {
+        retro_dsp_filter_free(m_pending_dsp_filter);
+        m_pending_dsp_filter = nullptr;
+    }
+
+    FreeResampler();
+}
+
+void AudioHandler::InitResampler()
+{
+    FreeResampler();
+
+    m_output_sample_rate = m_audio_sample_rate;
+    m_resampler_ratio = 1.0;
+
+    auto quality = static_cast<resampler_quality>(Wrapper::GetCurrent()->m_audio_resampler_quality.load());
+    if (quality == RESAMPLER_QUALITY_DONTCARE)
+        return;
+
+    // Resample once here to the rate the AudioServer mixes at so Godot's own per-mix resampling becomes a pass-through
+    double mix_rate = AudioServer::get_singleton()->get_mix_rate();
+    bool display_pacing = Wrapper::GetCurrent()->m_pacing_mode == PacingMode::Display;
+    if (mix_rate <= 0.0 || (std::abs(mix_rate - m_audio_sample_rate) < 0.5 && !display_pacing))
+        return;
+
+    m_resampler_ratio = mix_rate / m_audio_sample_rate;
+    if (!retro_resampler_realloc(&m_resampler_data, &m_resampler, "sinc", quality, m_resampler_ratio))
+    {
+        LogError("Failed to create audio resampler, falling back to Godot resampling.");
+        m_resampler = nullptr;
+        m_resampler_data = nullptr;
+        m_resampler_ratio = 1.0;
+        return;
+    }
+
+    m_output_sample_rate = mix_rate;
+    Log("Audio resampler: " + std::to_string(m_audio_sample_rate) + " Hz -> " + std::to_string(m_output_sample_rate) + " Hz (quality " + std::to_string(quality) + ")");
+}
+
+void AudioHandler::FreeResampler()
+{
+    if (m_resampler && m_resampler_data)
+        m_resampler->free(m_resampler_data);
+
+    m_resampler = nullptr;
+    m_resampler_data = nullptr;
 }
 
 bool AudioHandler::SetAudioBufferStatusCallback(const retro_audio_buffer_status_callback* callback)
@@ -109,14 +213,421 @@ bool AudioHandler::SetAudioBufferStatusCallback(const retro_audio_buffer_status_
 
 bool AudioHandler::SetMinimumAudioLatency(const uint32_t* minimum_audio_latency)
 {
-    if (minimum_audio_latency)
-        m_minimum_audio_latency = *minimum_audio_latency;
+    if (!minimum_audio_latency || *minimum_audio_latency == m_minimum_audio_latency)
+        return true;
+
+    m_minimum_audio_latency = *minimum_audio_latency;
+
+    // Set before audio init it is simply picked up by Init, afterwards the buffer has to be rebuilt
+    if (m_audio_stream_generator_playback.is_valid())
+        RequestResize();
+
     return true;
 }
 
+bool AudioHandler::SetAudioCallback(const retro_audio_callback* audio_callback)
+{
+    // Null data is a query for availability
+    if (!audio_callback)
+        return true;
+
+    m_audio_callback = *audio_callback;
+    return true;
+}
+
+void AudioHandler::StartAudioCallback()
+{
+    if (!m_audio_callback.callback || m_audio_callback_thread.joinable())
+        return;
+
+    m_audio_callback_running = true;
+    SetAudioCallbackState(true);
+    m_audio_callback_thread = std::thread(&AudioHandler::AudioCallbackThreadLoop, this, Wrapper::GetCurrent());
+}
+
+void AudioHandler::StopAudioCallback()
+{
+    if (!m_audio_callback_thread.joinable())
+        return;
+
+    SetAudioCallbackState(false);
+    m_audio_callback_running = false;
+    m_audio_callback_thread.join();
+}
+
+void AudioHandler::SetAudioCallbackState(bool enabled)
+{
+    if (!m_audio_callback.callback || m_audio_callback_enabled == enabled)
+        return;
+
+    m_audio_callback_enabled = enabled;
+    if (m_audio_callback.set_state)
+        m_audio_callback.set_state(enabled);
+}
+
+void AudioHandler::LoadDspFilter(const std::string& path)
+{
+    retro_dsp_filter_t* dsp_filter = nullptr;
+
+    if (!path.empty())
+    {
+        dsp_filter = retro_dsp_filter_new(path.c_str(), nullptr, static_cast<float>(m_audio_sample_rate));
+        if (!dsp_filter)
+        {
+            LogError("Failed to load DSP filter: " + path);
+            return;
+        }
+
+        Log("Loaded DSP filter: " + path);
+    }
+
+    // The producing thread swaps it in at the start of its next batch, this only locks when a change is pending
+    std::lock_guard<std::mutex> lock(m_dsp_filter_mutex);
+    if (m_pending_dsp_filter)
+        retro_dsp_filter_free(m_pending_dsp_filter);
+    m_pending_dsp_filter = dsp_filter;
+    m_dsp_filter_changed = true;
+}
+
+void AudioHandler::EndFrame()
+{
+    FlushStagedSamples();
+
+    double cost = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(m_push_mutex);
+        cost = m_dsp_frame_cost_usec;
+        m_dsp_frame_cost_usec = 0.0;
+    }
+
+    m_dsp_last_frame_cost_usec = cost;
+    m_dsp_average_frame_cost_usec = m_dsp_average_frame_cost_usec * 0.95 + cost * 0.05;
+    if (cost > m_dsp_max_frame_cost_usec)
+        m_dsp_max_frame_cost_usec = cost;
+
+    if (m_audio_stream_generator_playback.is_null())
+        return;
+
+    // Sampled on a fixed cadence so the histogram shows time spent at each fill, whatever the batch sizes or speed
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_fill_sample_time >= s_fill_sample_interval)
+    {
+        m_fill_sample_time = now;
+        uint32_t total_frames = m_audio_buffer_total_frames;
+        uint32_t fill_percent = total_frames > 0 ? std::min(static_cast<uint32_t>(100ull * GetQueuedFrames() / total_frames), 100u) : 0;
+        m_fill_histogram[std::min<size_t>(fill_percent * AudioStats::s_fill_histogram_buckets / 100, AudioStats::s_fill_histogram_buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Grow the target after a few consecutive seconds with underruns, shrink it back slowly once playback has been clean for a while.
+    // Only the pacing target moves, rebuilding the generator is an audible dropout and is left for growing past what it was built for
+    if (now - m_underrun_window_start < std::chrono::seconds(1))
+        return;
+
+    double elapsed_sec = std::chrono::duration<double>(now - m_underrun_window_start).count();
+    m_underrun_window_start = now;
+
+    int64_t skips = m_audio_stream_generator_playback->get_skips();
+    bool underran = skips != m_underrun_window_skips;
+    if (skips > m_underrun_window_skips)
+        m_underrun_events.fetch_add(skips - m_underrun_window_skips, std::memory_order_relaxed);
+    m_underrun_window_skips = skips;
+
+    uint64_t pushed_frames = m_pushed_frames.load(std::memory_order_relaxed);
+    uint64_t core_frames = m_core_frames.load(std::memory_order_relaxed);
+    uint32_t queued_frames = GetQueuedFrames();
+    double produced = static_cast<double>(pushed_frames - m_stats_window_pushed_frames);
+    double consumed = produced - (static_cast<double>(queued_frames) - static_cast<double>(m_stats_window_queued_frames));
+    m_produced_frames_per_sec.store(produced / elapsed_sec, std::memory_order_relaxed);
+    m_consumed_frames_per_sec.store(consumed / elapsed_sec, std::memory_order_relaxed);
+    m_effective_sample_rate.store(static_cast<double>(core_frames - m_stats_window_core_frames) / elapsed_sec, std::memory_order_relaxed);
+    m_stats_window_pushed_frames = pushed_frames;
+    m_stats_window_core_frames = core_frames;
+    m_stats_window_queued_frames = queued_frames;
+
+    if (underran)
+    {
+        m_stable_windows = 0;
+        if (++m_underrun_windows >= s_underrun_windows_to_grow && m_adaptive_scale < s_max_adaptive_scale)
+        {
+            m_adaptive_scale = std::min(m_adaptive_scale * 1.25f, s_max_adaptive_scale);
+            m_underrun_windows = 0;
+
+            float capacity_sec = m_audio_buffer_capacity_sec;
+            float desired_sec = GetDesiredCapacitySec();
+            if (desired_sec > capacity_sec)
+                RequestResize();
+            else
+                m_fill_scale = desired_sec / capacity_sec;
+        }
+    }
+    else
+    {
+        m_underrun_windows = 0;
+        if (++m_stable_windows >= s_stable_windows_to_shrink && m_adaptive_scale > 1.0f)
+        {
+            m_adaptive_scale = std::max(m_adaptive_scale * 0.9f, 1.0f);
+            m_stable_windows = 0;
+            m_fill_scale = GetDesiredCapacitySec() / m_audio_buffer_capacity_sec;
+        }
+    }
+}
+
+static constexpr double s_fade_sec = 0.01;
+
+void AudioHandler::SetPaused(bool paused)
+{
+    if (m_paused.exchange(paused) == paused)
+        return;
+
+    m_fade_frames = std::max<uint32_t>(static_cast<uint32_t>(m_output_sample_rate * s_fade_sec), 1);
+
+    if (paused)
+    {
+        SetAudioCallbackState(false);
+
+        // Cores using the audio callback push from their own thread, only a frame-driven core can be faded from here
+        if (!m_audio_callback.callback)
+            PushFadeOut();
+        return;
+    }
+
+    // The silence while paused shows up as skips, it must not count as underruns or grow the buffer
+    if (m_audio_stream_generator_playback.is_valid())
+        m_underrun_window_skips = m_audio_stream_generator_playback->get_skips();
+    m_underrun_window_start = std::chrono::steady_clock::now();
+    m_fade_in_frames_left = m_fade_frames;
+
+    SetAudioCallbackState(true);
+}
+
+void AudioHandler::PushFadeOut()
+{
+    if (m_audio_stream_generator_playback.is_null())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_push_mutex);
+
+    uint32_t total_frames = m_audio_buffer_total_frames;
+    uint32_t free_frames = total_frames - std::min(GetQueuedFrames(), total_frames);
+    uint32_t frames = std::min(m_fade_frames, free_frames);
+    if (frames == 0)
+        return;
+
+    PackedVector2Array fade;
+    fade.resize(frames);
+    Vector2* fade_frames = fade.ptrw();
+    for (uint32_t i = 0; i < frames; i++)
+        fade_frames[i] = m_last_output_frame * (1.0f - static_cast<float>(i + 1) / static_cast<float>(frames));
+
+    m_audio_stream_generator_playback->push_buffer(fade);
+    m_last_output_frame = Vector2();
+}
+
 void AudioHandler::CallAudioBufferStatusCallback()
 {
     if (m_audio_buffer_status_callback)
         m_audio_buffer_status_callback(true, m_audio_buffer_occupancy, m_audio_buffer_occupancy <= 10);
 }
+
+AudioStats AudioHandler::GetStats() const
+{
+    AudioStats stats;
+    stats.underruns               = m_underrun_events.load(std::memory_order_relaxed);
+    stats.dropped_frames          = m_dropped_frames.load(std::memory_order_relaxed);
+    stats.fill_percent            = m_audio_buffer_occupancy.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < AudioStats::s_fill_histogram_buckets; i++)
+        stats.fill_histogram[i]   = m_fill_histogram[i].load(std::memory_order_relaxed);
+    stats.produced_frames_per_sec = m_produced_frames_per_sec.load(std::memory_order_relaxed);
+    stats.consumed_frames_per_sec = m_consumed_frames_per_sec.load(std::memory_order_relaxed);
+    stats.effective_sample_rate   = m_effective_sample_rate.load(std::memory_order_relaxed);
+    stats.output_sample_rate      = m_output_sample_rate;
+    stats.buffer_capacity_sec     = m_audio_buffer_capacity_sec;
+    return stats;
+}
+
+double AudioHandler::GetRateControl(float target_fill)
+{
+    uint32_t total_frames = m_audio_buffer_total_frames;
+    if (m_audio_stream_generator_playback.is_null() || total_frames == 0)
+        return 1.0;
+
+    // The queue moves in whole mix periods, only its slow trend says anything about the rate
+    double fill = static_cast<double>(GetQueuedFrames()) / total_frames;
+    m_rate_control_fill = m_rate_control_fill < 0.0 ? fill : m_rate_control_fill * 0.98 + fill * 0.02;
+
+    double error = std::clamp((m_rate_control_fill - target_fill * m_fill_scale) * 2.0, -1.0, 1.0);
+    return 1.0 + error * s_rate_control_max_delta;
+}
+
+void AudioHandler::WaitForBufferBelow(float target_fill)
+{
+    if (m_audio_stream_generator_playback.is_null() || m_output_sample_rate <= 0.0)
+        return;
+
+    // If the device stops draining (player paused, audio server locked) give up after one full buffer worth of time instead of stalling the core
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_audio_buffer_capacity_sec));
+
+    while (Wrapper::GetCurrent()->m_running)
+    {
+        double target_frames = m_audio_buffer_total_frames * target_fill * m_fill_scale;
+        double excess_frames = GetQueuedFrames() - target_frames;
+        if (excess_frames <= 0.0)
+            return;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+            return;
+
+        auto drain_time = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(excess_frames / m_output_sample_rate));
+        std::this_thread::sleep_until(std::min(now + drain_time, deadline));
+    }
+}
+
+void AudioHandler::AudioCallbackThreadLoop(Wrapper* wrapper)
+{
+    Log("Audio callback thread starting...");
+
+    // The core renders audio from here, its sample callbacks must land in the session that started us
+    SessionScope scope(*wrapper);
+
+    while (m_audio_callback_running)
+    {
+        if (!m_audio_callback_enabled)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+
+        WaitForBufferBelow(Wrapper::GetCurrent()->m_audio_target_fill);
+
+        uint64_t pushed_frames = m_pushed_frames;
+        m_audio_callback.callback();
+        FlushStagedSamples();
+
+        // Core had nothing to render yet, don't spin on it
+        if (m_pushed_frames == pushed_frames)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    Log("Audio callback thread stopped.");
+}
+
+void AudioHandler::PushFrames(const int16_t* data, size_t frames)
+{
+    if (m_audio_stream_generator_playback.is_null() || frames == 0)
+        return;
+
+    // Uncontended unless the core renders from both its audio callback and retro_run, then it keeps the two streams from interleaving
+    std::lock_guard<std::mutex> lock(m_push_mutex);
+
+    if (m_dsp_filter_changed)
+    {
+        std::lock_guard<std::mutex> lock(m_dsp_filter_mutex);
+        if (m_dsp_filter)
+            retro_dsp_filter_free(m_dsp_filter);
+        m_dsp_filter = m_pending_dsp_filter;
+        m_pending_dsp_filter = nullptr;
+        m_dsp_filter_changed = false;
+    }
+
+    if (m_drop_audio)
+    {
+        m_core_frames.fetch_add(frames, std::memory_order_relaxed);
+        return;
+    }
+
+    // Only grows until the largest batch the core sends has been seen once
+    size_t samples = frames * 2;
+    if (m_float_buffer.size() < samples)
+        m_float_buffer.resize(samples);
+
+    convert_s16_to_float(m_float_buffer.data(), data, samples, 1.0f);
+
+    const float* output = m_float_buffer.data();
+    size_t output_frames = frames;
+
+    if (m_dsp_filter)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        retro_dsp_data dsp_data = {};
+        dsp_data.input          = m_float_buffer.data();
+        dsp_data.input_frames   = static_cast<unsigned>(frames);
+        retro_dsp_filter_process(m_dsp_filter, &dsp_data);
+
+        output        = dsp_data.output;
+        output_frames = dsp_data.output_frames;
+
+        m_dsp_frame_cost_usec += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (m_resampler_data && output_frames > 0)
+    {
+        // The sinc filter keeps its own history, so fractional output frames carry over into the next batch
+        double ratio = m_resampler_ratio / m_rate_adjust;
+        size_t max_output_frames = static_cast<size_t>(output_frames * ratio) + 16;
+        if (m_resample_buffer.size() < max_output_frames * 2)
+            m_resample_buffer.resize(max_output_frames * 2);
+
+        resampler_data resample_data = {};
+        resample_data.data_in        = output;
+        resample_data.data_out       = m_resample_buffer.data();
+        resample_data.input_frames   = output_frames;
+        resample_data.ratio          = ratio;
+        m_resampler->process(m_resampler_data, &resample_data);
+
+        output        = m_resample_buffer.data();
+        output_frames = resample_data.output_frames;
+    }
+
+    if (output_frames == 0)
+        return;
+
+    m_core_frames.fetch_add(frames, std::memory_order_relaxed);
+
+    // Occupancy is sampled before the push, which is what the core's buffer status callback describes
+    uint32_t queued_frames = GetQueuedFrames();
+    uint32_t total_frames = m_audio_buffer_total_frames;
+    uint32_t occupancy_percent = total_frames > 0 ? std::min(static_cast<uint32_t>(100ull * queued_frames / total_frames), 100u) : 0;
+    m_audio_buffer_occupancy.store(occupancy_percent, std::memory_order_relaxed);
+
+    // push_buffer is all or nothing, keep what fits and count the rest as dropped
+    uint32_t free_frames = total_frames - std::min(queued_frames, total_frames);
+    if (output_frames > free_frames)
+    {
+        m_dropped_frames.fetch_add(output_frames - free_frames, std::memory_order_relaxed);
+        output_frames = free_frames;
+        if (output_frames == 0)
+            return;
+    }
+
+    static_assert(sizeof(Vector2) == sizeof(float) * 2, "Interleaved stereo floats are copied straight into Vector2 frames");
+
+    if (m_push_buffer.size() != static_cast<int64_t>(output_frames))
+        m_push_buffer.resize(output_frames);
+
+    Vector2* push_frames = m_push_buffer.ptrw();
+    std::memcpy(push_frames, output, output_frames * sizeof(Vector2));
+
+    // Ramp back up after a pause instead of jumping straight to full amplitude
+    for (size_t i = 0; i < output_frames && m_fade_in_frames_left > 0; i++, m_fade_in_frames_left--)
+        push_frames[i] *= 1.0f - static_cast<float>(m_fade_in_frames_left) / static_cast<float>(m_fade_frames);
+
+    m_last_output_frame = push_frames[output_frames - 1];
+    m_audio_stream_generator_playback->push_buffer(m_push_buffer);
+
+    m_pushed_frames.fetch_add(output_frames, std::memory_order_relaxed);
+}
+
+uint32_t AudioHandler::GetQueuedFrames()
+{
+    if (m_audio_stream_generator_playback.is_null())
+        return 0;
+
+    uint32_t available_frames = m_audio_stream_generator_playback->get_frames_available();
+    if (available_frames > m_audio_buffer_total_frames)
+        m_audio_buffer_total_frames = available_frames;
+
+    return m_audio_buffer_total_frames - available_frames;
+}
 }
@@ -4,36 +4,166 @@
 #include <godot_cpp/classes/audio_stream_generator.hpp>
 #include <godot_cpp/classes/audio_stream_generator_playback.hpp>
 #include <godot_cpp/classes/audio_stream_player.hpp>
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/variant/packed_vector2_array.hpp>
 
 #include <cstdint>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <libretro.h>
+#include <audio/dsp_filter.h>
+#include <audio/audio_resampler.h>
 
 namespace SK
 {
+class Wrapper;
+
+// Snapshot of the per-session audio counters, every field is read from a relaxed atomic so values may be a batch apart
+struct AudioStats
+{
+    static constexpr size_t s_fill_histogram_buckets = 10;
+
+    uint64_t underruns = 0;
+    uint64_t dropped_frames = 0;
+    uint32_t fill_percent = 0;
+    std::array<uint64_t, s_fill_histogram_buckets> fill_histogram = {};
+    double produced_frames_per_sec = 0.0;
+    double consumed_frames_per_sec = 0.0;
+    double effective_sample_rate = 0.0;
+    double output_sample_rate = 0.0;
+    float buffer_capacity_sec = 0.0f;
+};
+
 class AudioHandler
 {
 public:
     static void SampleCallback(int16_t left, int16_t right);
     static size_t SampleBatchCallback(const int16_t* data, size_t frames);
 
-    void Init(float buffer_capacity_sec, double sample_rate);
+    // The generator buffer is sized from the requested latency, the core's minimum latency and the AudioServer output latency
+    void Init(float latency_sec, double sample_rate);
     void DeInit();
 
     bool SetAudioBufferStatusCallback(const retro_audio_buffer_status_callback* callback);
     bool SetMinimumAudioLatency(const uint32_t* minimum_audio_latency);
+    bool SetAudioCallback(const retro_audio_callback* audio_callback);
+
+    // Cores registering RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK render audio on demand from a dedicated thread instead of inside retro_run
+    void StartAudioCallback();
+    void StopAudioCallback();
+    void SetAudioCallbackState(bool enabled);
+    bool IsAudioCallbackRunning() const { return m_audio_callback_running; }
+    // Forgets the callback of an unloaded game, the thread must already be stopped
+    void ClearAudioCallback() { m_audio_callback = {}; m_audio_callback_enabled = false; }
+
+    // Loads a libretro-common .dsp filter chain, an empty path removes the current one
+    void LoadDspFilter(const std::string& path);
+    void EndFrame();
+    void RequestResize() { m_resize_requested = true; }
+    // Fast-forwarded audio is discarded rather than piling up in the buffer
+    void SetDropAudio(bool drop) { m_drop_audio = drop; }
+    // Pushes whatever SampleCallback staged on the calling thread, due before SetDropAudio changes mid-frame
+    void FlushStagedSamples();
+    // The core runs speed times faster than its nominal fps, the resampler stretches its audio back to real time
+    void SetRateAdjust(double speed) { m_rate_adjust = speed; }
+    // Emulation thread, a factor within a fraction of a percent of 1 that steers the smoothed buffer fill towards target_fill
+    double GetRateControl(float target_fill);
+    // Fades the output out and stops the core's audio callback, resuming fades back in
+    void SetPaused(bool paused);
+    bool GetResizeRequested() const { return m_resize_requested; }
+    float GetBufferCapacitySec() const { return m_audio_buffer_capacity_sec; }
+    double GetSampleRate() const { return m_audio_sample_rate; }
+    double GetDspLastFrameCostUsec() const { return m_dsp_last_frame_cost_usec; }
+    double GetDspAverageFrameCostUsec() const { return m_dsp_average_frame_cost_usec; }
+    double GetDspMaxFrameCostUsec() const { return m_dsp_max_frame_cost_usec; }
 
     void CallAudioBufferStatusCallback();
+    AudioStats GetStats() const;
+
+    // Blocks the calling thread until the queued audio drops to target_fill (0..1) of the buffer capacity
+    void WaitForBufferBelow(float target_fill);
+    uint64_t GetPushedFrames() const { return m_pushed_frames; }
 
 private:
     godot::Ref<godot::AudioStreamGenerator> m_audio_stream_generator = nullptr;
     godot::Ref<godot::AudioStreamGeneratorPlayback> m_audio_stream_generator_playback = nullptr;
     godot::AudioStreamPlayer* m_audio_stream_player = nullptr;
-    float m_audio_buffer_capacity_sec = 0;
+    std::atomic<float> m_audio_buffer_capacity_sec = 0;
     double m_audio_sample_rate = 0.0;
-    uint32_t m_audio_buffer_total_frames = 0;
-    uint32_t m_audio_buffer_occupancy = 0;
+    double m_output_sample_rate = 0.0;
+    std::atomic<uint32_t> m_audio_buffer_total_frames = 0;
+    std::atomic<uint32_t> m_audio_buffer_occupancy = 0;
     retro_audio_buffer_status_callback_t m_audio_buffer_status_callback = nullptr;
     uint32_t m_minimum_audio_latency = 0;
+    std::atomic<bool> m_resize_requested = false;
+    std::atomic<bool> m_drop_audio = false;
+    std::atomic<bool> m_paused = false;
+    godot::Vector2 m_last_output_frame;
+    uint32_t m_fade_frames = 1;
+    uint32_t m_fade_in_frames_left = 0;
+    float m_adaptive_scale = 1.0f;
+    // What the generator was built for that isn't the user latency: the core's minimum and the output latency
+    float m_latency_sec = 0.0f;
+    float m_minimum_capacity_sec = 0.0f;
+    // Share of the built capacity the pacing fills to, adaptive steps move this instead of rebuilding the generator
+    std::atomic<float> m_fill_scale = 1.0f;
+    std::chrono::steady_clock::time_point m_underrun_window_start = {};
+    int64_t m_underrun_window_skips = 0;
+    uint32_t m_underrun_windows = 0;
+    uint32_t m_stable_windows = 0;
+    std::atomic<uint64_t> m_pushed_frames = 0;
+
+    // Written by whichever thread produces audio, read from the main thread without locking
+    std::atomic<uint64_t> m_core_frames = 0;
+    std::atomic<uint64_t> m_underrun_events = 0;
+    std::atomic<uint64_t> m_dropped_frames = 0;
+    std::array<std::atomic<uint64_t>, AudioStats::s_fill_histogram_buckets> m_fill_histogram = {};
+    std::chrono::steady_clock::time_point m_fill_sample_time = {};
+    std::atomic<double> m_produced_frames_per_sec = 0.0;
+    std::atomic<double> m_consumed_frames_per_sec = 0.0;
+    std::atomic<double> m_effective_sample_rate = 0.0;
+    uint64_t m_stats_window_pushed_frames = 0;
+    uint64_t m_stats_window_core_frames = 0;
+    uint32_t m_stats_window_queued_frames = 0;
+
+    retro_audio_callback m_audio_callback = {};
+    std::thread m_audio_callback_thread;
+    std::atomic<bool> m_audio_callback_running = false;
+    std::atomic<bool> m_audio_callback_enabled = false;
+
+    // The emulation thread and the core's audio callback thread may both push, everything a push touches is behind this
+    std::mutex m_push_mutex;
+    std::vector<float> m_float_buffer;
+    godot::PackedVector2Array m_push_buffer;
+
+    const retro_resampler_t* m_resampler = nullptr;
+    void* m_resampler_data = nullptr;
+    double m_resampler_ratio = 1.0;
+    std::atomic<double> m_rate_adjust = 1.0;
+    double m_rate_control_fill = -1.0;
+    std::vector<float> m_resample_buffer;
+
+    retro_dsp_filter_t* m_dsp_filter = nullptr;
+    retro_dsp_filter_t* m_pending_dsp_filter = nullptr;
+    std::atomic<bool> m_dsp_filter_changed = false;
+    std::mutex m_dsp_filter_mutex;
+    double m_dsp_frame_cost_usec = 0.0;
+    std::atomic<double> m_dsp_last_frame_cost_usec = 0.0;
+    std::atomic<double> m_dsp_average_frame_cost_usec = 0.0;
+    std::atomic<double> m_dsp_max_frame_cost_usec = 0.0;
+
+    uint32_t GetQueuedFrames();
+    void PushFrames(const int16_t* data, size_t frames);
+    void PushFadeOut();
+    void AudioCallbackThreadLoop(Wrapper* wrapper);
+    void InitResampler();
+    void FreeResampler();
+    float GetDesiredCapacitySec() const;
 };
 }
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <array>
+#include <utility>
+
+namespace SK
+{
+// Single producer, single consumer ring with the elements stored inline, nothing is allocated after construction
+template<typename T, size_t Capacity>
+class CommandRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer only, false when the consumer is Capacity elements behind
+    bool TryPush(T&& value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        m_slots[tail & (Capacity - 1)] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, the element stays valid until Pop
+    T* Front()
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &m_slots[head & (Capacity - 1)];
+    }
+
+    // Consumer only, resets the slot so whatever it referenced is released right away
+    void Pop()
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        m_slots[head & (Capacity - 1)] = T();
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    void Clear()
+    {
+        while (Front())
+            Pop();
+    }
+
+    // Approximate when read from the producer side
+    size_t Size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+    static constexpr size_t GetCapacity() { return Capacity; }
+
+private:
+    std::array<T, Capacity> m_slots = {};
+    // Kept on their own cache lines so the two threads don't bounce a shared one
+    alignas(64) std::atomic<size_t> m_head = 0;
+    alignas(64) std::atomic<size_t> m_tail = 0;
+};
+}
@@ -61,7 +61,7 @@ bool Core::Load()
     m_name = name;
 
     std::string extension = std::filesystem::path(m_path).extension().string();
-    std::filesystem::path temp_path = std::filesystem::path(Wrapper::GetInstance()->GetTempDirectory()) / (name + GenerateHex(10) + extension);
+    std::filesystem::path temp_path = std::filesystem::path(Wrapper::GetCurrent()->GetTempDirectory()) / (name + GenerateHex(10) + extension);
     if (!std::filesystem::copy_file(m_path, temp_path, std::filesystem::copy_options::overwrite_existing))
     {
         LogError("Failed to copy core file: " + m_path + " to " + temp_path.string());
@@ -69,6 +69,7 @@ bool Core::Load()
     }
 
     m_path = temp_path.string();
+    m_is_temp_copy = true;
     std::replace(m_path.begin(), m_path.end(), '\\', '/');
 
     if (!LoadHandle())
@@ -120,7 +121,8 @@ void Core::Unload()
         m_handle = nullptr;
     }
 
-    if (std::filesystem::is_regular_file(m_path))
+    // Only the temp copy, a core that was never loaded (out of process sessions) still points at the original
+    if (m_is_temp_copy && std::filesystem::is_regular_file(m_path))
         if (!std::filesystem::remove(m_path))
             LogError("Core file not found for removal: " + m_path);
 }
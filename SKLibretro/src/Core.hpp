@@ -58,6 +58,7 @@ private:
     std::string m_path;
     void* m_handle = nullptr;
     bool m_supports_no_game = false;
+    bool m_is_temp_copy = false;
 
     bool LoadHandle();
 
@@ -0,0 +1,34 @@
+#include "DisplayClock.hpp"
+
+namespace SK
+{
+void DisplayClock::Tick()
+{
+    auto now = FrameScheduler::Clock::now();
+    if (m_last_tick_time != FrameScheduler::Clock::time_point())
+    {
+        double interval_sec = std::chrono::duration<double>(now - m_last_tick_time).count();
+        m_tick_interval_sec = m_tick_interval_sec > 0.0 ? m_tick_interval_sec * 0.95 + interval_sec * 0.05 : interval_sec;
+        m_measured_rate = m_tick_interval_sec > 0.0 ? 1.0 / m_tick_interval_sec : 0.0;
+    }
+    m_last_tick_time = now;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ticks++;
+    }
+    m_condition.notify_all();
+}
+
+uint64_t DisplayClock::GetTicks()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ticks;
+}
+
+bool DisplayClock::WaitForTicks(uint64_t target, std::chrono::nanoseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_condition.wait_for(lock, timeout, [&]{ return m_ticks >= target; });
+}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include "FrameScheduler.hpp"
+
+namespace SK
+{
+// Counts rendered Godot frames so the emulation thread can run in step with the display
+class DisplayClock
+{
+public:
+    // Main thread, once per _process
+    void Tick();
+    void SetRefreshRate(double refresh_rate) { m_refresh_rate = refresh_rate; }
+    double GetRefreshRate() const { return m_refresh_rate; }
+    // Rate the ticks actually arrive at, 0 until a few have been seen
+    double GetMeasuredRate() const { return m_measured_rate; }
+    uint64_t GetTicks();
+
+    // Blocks until at least target ticks have been counted, false on timeout
+    bool WaitForTicks(uint64_t target, std::chrono::nanoseconds timeout);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    uint64_t m_ticks = 0;
+
+    std::atomic<double> m_refresh_rate = 0.0;
+    std::atomic<double> m_measured_rate = 0.0;
+    double m_tick_interval_sec = 0.0;
+    FrameScheduler::Clock::time_point m_last_tick_time = {};
+};
+}
@@ -54,14 +54,10 @@ static void retro_perf_log()
 
 static bool runloop_clear_all_thread_waits(uint32_t clear_threads, void* data)
 {
-    if (clear_threads > 0)
-    {
-        // start audio
-    }
-    else
-    {
-        // stop audio
-    }
+    // Threaded cores stop our audio before blocking on their own threads and restart it afterwards
+    auto instance = Wrapper::GetCurrent();
+    if (instance->m_audio_handler)
+        instance->m_audio_handler->SetPaused(clear_threads == 0);
 
     return true;
 }
@@ -207,15 +203,67 @@ EnvironmentHandler::EnvironmentHandler()
     };    
 }
 
+// Commands that install callbacks or change what the frontend presents, only the primary core gets to make them
+static bool IsPrimaryOnly(uint32_t cmd)
+{
+    switch (cmd & ~RETRO_ENVIRONMENT_EXPERIMENTAL)
+    {
+    case RETRO_ENVIRONMENT_SET_ROTATION:
+    case RETRO_ENVIRONMENT_SET_MESSAGE:
+    case RETRO_ENVIRONMENT_SHUTDOWN:
+    case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
+    case RETRO_ENVIRONMENT_SET_KEYBOARD_CALLBACK:
+    case RETRO_ENVIRONMENT_SET_DISK_CONTROL_INTERFACE:
+    case RETRO_ENVIRONMENT_SET_HW_RENDER:
+    case RETRO_ENVIRONMENT_SET_VARIABLES:
+    case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME:
+    case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK:
+    case RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK:
+    case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO:
+    case RETRO_ENVIRONMENT_SET_SUBSYSTEM_INFO:
+    case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO:
+    case RETRO_ENVIRONMENT_SET_MEMORY_MAPS:
+    case RETRO_ENVIRONMENT_SET_GEOMETRY:
+    case RETRO_ENVIRONMENT_SET_CORE_OPTIONS:
+    case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_INTL:
+    case RETRO_ENVIRONMENT_SET_DISK_CONTROL_EXT_INTERFACE:
+    case RETRO_ENVIRONMENT_SET_MESSAGE_EXT:
+    case RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK:
+    case RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY:
+    case RETRO_ENVIRONMENT_SET_FASTFORWARDING_OVERRIDE:
+    case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2:
+    case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2_INTL:
+    case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK:
+    case RETRO_ENVIRONMENT_SET_VARIABLE:
+        return true;
+    default:
+        return false;
+    }
+}
+
 bool EnvironmentHandler::Callback(uint32_t cmd, void* data)
 {
-    auto instance = Wrapper::GetInstance();
-    if (!instance)
+    auto session = Wrapper::GetSession();
+    if (!session->environment)
     {
-        LogError("Callback: Null Instance.");
+        LogError("Callback: No session.");
         return false;
     }
 
+    auto instance = session->wrapper;
+
+    // The run-ahead second instance shares this session, let it believe it succeeded without touching anything the primary set up
+    if (session->secondary_core && IsPrimaryOnly(cmd))
+        return cmd != RETRO_ENVIRONMENT_SET_HW_RENDER;
+
+    // Reading the update flag clears it, the primary must be the one to see an option change
+    if (session->secondary_core && cmd == RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE)
+    {
+        if (data)
+            *static_cast<bool*>(data) = false;
+        return true;
+    }
+
     switch (cmd)
     {
     case RETRO_ENVIRONMENT_SET_ROTATION:                                        return instance->m_video_handler->SetRotation(*static_cast<uint32_t*>(data));
@@ -235,8 +283,8 @@ bool EnvironmentHandler::Callback(uint32_t cmd, void* data)
     case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:                                 return instance->m_options_handler->GetVariableUpdate(static_cast<bool*>(data));
     case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME:                                 return instance->m_core->SetSupportsNoGame(static_cast<bool*>(data));
     case RETRO_ENVIRONMENT_GET_LIBRETRO_PATH:                                   return instance->m_core->GetLibretroPath(static_cast<const char**>(data));
-    case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK:                             return EnvironmentNotImplemented(cmd);
-    case RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK:                                  return EnvironmentNotImplemented(cmd);
+    case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK:                             return instance->m_environment_handler->SetFrameTimeCallback(static_cast<const retro_frame_time_callback*>(data));
+    case RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK:                                  return instance->m_audio_handler->SetAudioCallback(static_cast<const retro_audio_callback*>(data));
     case RETRO_ENVIRONMENT_GET_RUMBLE_INTERFACE:                                return instance->m_input_handler->GetRumbleInterface(static_cast<retro_rumble_interface*>(data));
     case RETRO_ENVIRONMENT_GET_INPUT_DEVICE_CAPABILITIES:                       return instance->m_input_handler->GetInputDeviceCapabilities(static_cast<uint32_t*>(data));
     case RETRO_ENVIRONMENT_GET_SENSOR_INTERFACE:                                return EnvironmentNotImplemented(cmd);
@@ -265,7 +313,7 @@ bool EnvironmentHandler::Callback(uint32_t cmd, void* data)
     case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:                              return instance->m_environment_handler->GetAudioVideoEnable(static_cast<retro_av_enable_flags*>(data));
     case RETRO_ENVIRONMENT_GET_MIDI_INTERFACE:                                  return EnvironmentNotImplemented(cmd);
     case RETRO_ENVIRONMENT_GET_FASTFORWARDING:                                  return instance->m_environment_handler->GetFastForwarding(static_cast<bool*>(data));
-    case RETRO_ENVIRONMENT_GET_TARGET_REFRESH_RATE:                             return EnvironmentNotImplemented(cmd);
+    case RETRO_ENVIRONMENT_GET_TARGET_REFRESH_RATE:                             return instance->m_environment_handler->GetTargetRefreshRate(static_cast<float*>(data));
     case RETRO_ENVIRONMENT_GET_INPUT_BITMASKS:                                  return instance->m_input_handler->GetInputBitmasks(static_cast<bool*>(data));
     case RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION:                            return instance->m_options_handler->GetCoreOptionsVersion(static_cast<uint32_t*>(data));
     case RETRO_ENVIRONMENT_SET_CORE_OPTIONS:                                    return instance->m_options_handler->SetCoreOptions(static_cast<const retro_core_option_definition*>(data));
@@ -279,7 +327,7 @@ bool EnvironmentHandler::Callback(uint32_t cmd, void* data)
     case RETRO_ENVIRONMENT_GET_INPUT_MAX_USERS:                                 return EnvironmentNotImplemented(cmd);
     case RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK:                    return instance->m_audio_handler->SetAudioBufferStatusCallback(static_cast<const retro_audio_buffer_status_callback*>(data));
     case RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY:                           return instance->m_audio_handler->SetMinimumAudioLatency(static_cast<const uint32_t*>(data));
-    case RETRO_ENVIRONMENT_SET_FASTFORWARDING_OVERRIDE:                         return EnvironmentNotImplemented(cmd);
+    case RETRO_ENVIRONMENT_SET_FASTFORWARDING_OVERRIDE:                         return instance->m_environment_handler->SetFastForwardingOverride(static_cast<const retro_fastforwarding_override*>(data));
     case RETRO_ENVIRONMENT_SET_CONTENT_INFO_OVERRIDE:                           return EnvironmentNotImplemented(cmd);
     case RETRO_ENVIRONMENT_GET_GAME_INFO_EXT:                                   return EnvironmentNotImplemented(cmd);
     case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2:                                 return instance->m_options_handler->SetCoreOptionsV2(static_cast<const retro_core_options_v2*>(data));
@@ -287,9 +335,9 @@ bool EnvironmentHandler::Callback(uint32_t cmd, void* data)
     case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_UPDATE_DISPLAY_CALLBACK:            return instance->m_options_handler->SetCoreOptionsUpdateDisplayCallback(static_cast<const retro_core_options_update_display_callback*>(data));
     case RETRO_ENVIRONMENT_SET_VARIABLE:                                        return instance->m_options_handler->SetVariable(static_cast<const retro_variable*>(data));
     case RETRO_ENVIRONMENT_GET_THROTTLE_STATE:                                  return instance->m_environment_handler->GetThrottleState(static_cast<retro_throttle_state*>(data));
-    case RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT:                               return EnvironmentNotImplemented(cmd);
+    case RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT:                               return instance->m_environment_handler->GetSavestateContext(static_cast<retro_savestate_context*>(data));
     case RETRO_ENVIRONMENT_GET_HW_RENDER_CONTEXT_NEGOTIATION_INTERFACE_SUPPORT: return EnvironmentNotImplemented(cmd);
-    case RETRO_ENVIRONMENT_GET_JIT_CAPABLE:                                     return EnvironmentNotImplemented(cmd);
+    case RETRO_ENVIRONMENT_GET_JIT_CAPABLE:                                     return instance->m_environment_handler->GetJitCapable(static_cast<bool*>(data));
     case RETRO_ENVIRONMENT_GET_MICROPHONE_INTERFACE:                            return EnvironmentNotImplemented(cmd);
     case RETRO_ENVIRONMENT_GET_DEVICE_POWER:                                    return EnvironmentNotImplemented(cmd);
     case RETRO_ENVIRONMENT_SET_NETPACKET_INTERFACE:                             return EnvironmentNotImplemented(cmd);
@@ -428,6 +476,8 @@ bool EnvironmentHandler::SetSystemAvInfo(const retro_system_av_info* av_info)
         " (aspect ratio: " + std::to_string(av_info->geometry.aspect_ratio) + ")" +
         "FPS: " + std::to_string(av_info->timing.fps) + " Sample Rate: " + std::to_string(av_info->timing.sample_rate));
 
+    // Scheduler, audio and video are reconfigured at the end of the current retro_run
+    Wrapper::GetSession()->wrapper->m_pending_av_info = *av_info;
     return true;
 }
 
@@ -474,7 +524,7 @@ bool EnvironmentHandler::SetMemoryMaps(const retro_memory_map* memory_maps)
 bool EnvironmentHandler::GetUsername(const char** username) const
 {
     if (username)
-        *username = Wrapper::GetInstance()->m_username.c_str();
+        *username = Wrapper::GetCurrent()->m_username.c_str();
     return true;
 }
 
@@ -485,6 +535,28 @@ bool EnvironmentHandler::GetLanguage(retro_language* language) const
     return true;
 }
 
+bool EnvironmentHandler::GetTargetRefreshRate(float* refresh_rate) const
+{
+    if (!refresh_rate)
+        return false;
+
+    // Only display pacing targets the monitor, the other modes run at the core's own rate
+    auto instance = Wrapper::GetCurrent();
+    double display_rate = instance->m_display_clock.GetRefreshRate();
+    if (instance->m_pacing_mode == PacingMode::Display && display_rate > 0.0)
+        *refresh_rate = static_cast<float>(display_rate);
+    else
+        *refresh_rate = static_cast<float>(instance->m_core_fps);
+    return true;
+}
+
+bool EnvironmentHandler::GetJitCapable(bool* jit_capable) const
+{
+    if (jit_capable)
+        *jit_capable = Wrapper::GetCurrent()->m_session_thread_settings.allow_jit && ThreadSettings::IsJitCapable();
+    return true;
+}
+
 bool EnvironmentHandler::SetSupportAchievements(bool* support)
 {
     if (support)
@@ -517,21 +589,36 @@ bool EnvironmentHandler::GetVfsInterface(retro_vfs_interface_info* vfs_interface
 bool EnvironmentHandler::GetLedInterface(retro_led_interface* led_interface)
 {
     if (led_interface)
-        led_interface->set_led_state = Wrapper::GetInstance()->LedInterfaceSetLedState;
+        led_interface->set_led_state = Wrapper::GetCurrent()->LedInterfaceSetLedState;
     return true;
 }
 
 bool EnvironmentHandler::GetAudioVideoEnable(retro_av_enable_flags* audio_video_enable)
 {
-    if (audio_video_enable)
-        *audio_video_enable = static_cast<retro_av_enable_flags>(RETRO_AV_ENABLE_AUDIO | RETRO_AV_ENABLE_VIDEO);
+    if (!audio_video_enable)
+        return true;
+
+    // Frames that won't be shown and audio that will be dropped let the core skip that work
+    auto session = Wrapper::GetSession();
+    int flags = 0;
+    if (session->present_frame)
+        flags |= RETRO_AV_ENABLE_VIDEO;
+    if (!session->drop_audio)
+        flags |= RETRO_AV_ENABLE_AUDIO;
+    // Run-ahead states never leave this process and speculative audio is never heard
+    if (session->savestate_context != RETRO_SAVESTATE_CONTEXT_NORMAL)
+        flags |= RETRO_AV_ENABLE_FAST_SAVESTATES;
+    if (session->speculative)
+        flags |= RETRO_AV_ENABLE_HARD_DISABLE_AUDIO;
+
+    *audio_video_enable = static_cast<retro_av_enable_flags>(flags);
     return true;
 }
 
 bool EnvironmentHandler::GetFastForwarding(bool* fast_forwarding)
 {
     if (fast_forwarding)
-        *fast_forwarding = false;
+        *fast_forwarding = Wrapper::GetCurrent()->GetSpeedRatio() != 1.0f;
     return true;
 }
 
@@ -554,13 +641,52 @@ bool EnvironmentHandler::SetDiskControlExtInterface(const retro_disk_control_ext
     return true;
 }
 
+bool EnvironmentHandler::GetSavestateContext(retro_savestate_context* context) const
+{
+    if (!context)
+        return true;
+
+    *context = Wrapper::GetSession()->savestate_context;
+    return true;
+}
+
 bool EnvironmentHandler::GetThrottleState(retro_throttle_state* state)
 {
-    if (state)
+    if (!state)
+        return true;
+
+    auto instance = Wrapper::GetCurrent();
+    float speed_ratio = instance->GetSpeedRatio();
+    if (instance->IsPaused())
     {
-        state->mode = RETRO_THROTTLE_NONE;
+        state->mode = RETRO_THROTTLE_FRAME_STEPPING;
+        state->rate = 0.0f;
+    }
+    else if (instance->m_display_locked_rate > 0.0)
+    {
+        state->mode = RETRO_THROTTLE_VSYNC;
+        state->rate = static_cast<float>(instance->m_display_locked_rate);
+    }
+    else if (speed_ratio < 1.0f)
+    {
+        state->mode = RETRO_THROTTLE_UNBLOCKED;
         state->rate = 0.0f;
     }
+    else if (speed_ratio > 1.0f)
+    {
+        state->mode = RETRO_THROTTLE_FAST_FORWARD;
+        state->rate = static_cast<float>(instance->m_core_fps * speed_ratio);
+    }
+    else if (instance->m_slow_motion > 1.0f)
+    {
+        state->mode = RETRO_THROTTLE_SLOW_MOTION;
+        state->rate = static_cast<float>(instance->m_core_fps / instance->m_slow_motion);
+    }
+    else
+    {
+        state->mode = RETRO_THROTTLE_NONE;
+        state->rate = static_cast<float>(instance->m_core_fps);
+    }
 
     return true;
 }
@@ -571,4 +697,44 @@ bool EnvironmentHandler::GetClearAllThreadWaitsCb(retro_environment_t* env)
         *env = runloop_clear_all_thread_waits;
     return true;
 }
+
+bool EnvironmentHandler::SetFastForwardingOverride(const retro_fastforwarding_override* fastforwarding_override)
+{
+    if (fastforwarding_override)
+        m_fastforwarding_override = *fastforwarding_override;
+    return true;
+}
+
+bool EnvironmentHandler::SetFrameTimeCallback(const retro_frame_time_callback* callback)
+{
+    if (!callback)
+        return false;
+
+    m_frame_time_callback = *callback;
+    m_last_frame_time.reset();
+    return true;
+}
+
+void EnvironmentHandler::ResetGameCallbacks()
+{
+    m_frame_time_callback = {};
+    m_fastforwarding_override = {};
+    m_last_frame_time.reset();
+}
+
+void EnvironmentHandler::CallFrameTimeCallback(bool use_reference)
+{
+    if (!m_frame_time_callback.callback)
+        return;
+
+    auto now = FrameScheduler::Clock::now();
+    retro_usec_t delta = m_frame_time_callback.reference;
+
+    // The first frame has nothing to measure against, and an unthrottled run must look like real time to the core
+    if (!use_reference && m_last_frame_time)
+        delta = std::chrono::duration_cast<std::chrono::microseconds>(now - *m_last_frame_time).count();
+
+    m_last_frame_time = now;
+    m_frame_time_callback.callback(delta);
+}
 }
@@ -3,9 +3,12 @@
 #include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <optional>
 
 #include <libretro.h>
 
+#include "FrameScheduler.hpp"
+
 namespace SK
 {
 class Wrapper;
@@ -19,6 +22,13 @@ public:
     static bool Callback(uint32_t cmd, void* data);
 
     void SetDirectories(const std::string& system_directory, const std::string& save_directory, const std::string& core_assets_directory);
+    // Called right before retro_run, use_reference reports the core's reference delta instead of the measured one
+    void CallFrameTimeCallback(bool use_reference);
+    // The next frame reports the reference delta, for frames that follow a pause rather than the previous frame
+    void ResetFrameTimeBaseline() { m_last_frame_time.reset(); }
+    const retro_fastforwarding_override& GetFastForwardingOverride() const { return m_fastforwarding_override; }
+    // Drops what an unloaded game registered, so the next one starts from the frontend defaults
+    void ResetGameCallbacks();
     
 private:
     static const uint32_t s_supported_vfs_version = 3;
@@ -30,6 +40,9 @@ private:
     retro_vfs_interface m_vfs_interface;
     retro_disk_control_callback m_disk_control_callback = {};
     retro_disk_control_ext_callback m_disk_control_ext_callback = {};
+    retro_frame_time_callback m_frame_time_callback = {};
+    retro_fastforwarding_override m_fastforwarding_override = {};
+    std::optional<FrameScheduler::Clock::time_point> m_last_frame_time;
 
     bool SetPerformanceLevel(uint32_t* level);
     bool GetSystemDirectory(const char** directory);
@@ -42,6 +55,8 @@ private:
     bool SetMemoryMaps(const retro_memory_map* memory_maps);
     bool GetUsername(const char** username) const;
     bool GetLanguage(retro_language* language) const;
+    bool GetJitCapable(bool* jit_capable) const;
+    bool GetTargetRefreshRate(float* refresh_rate) const;
     bool SetSupportAchievements(bool* support);
     bool GetVfsInterface(retro_vfs_interface_info* vfs_interface_info);
     bool GetLedInterface(retro_led_interface* led_interface);
@@ -50,6 +65,9 @@ private:
     bool GetDiskControlInterfaceVersion(uint32_t* version);
     bool SetDiskControlExtInterface(const retro_disk_control_ext_callback* callback);
     bool GetThrottleState(retro_throttle_state* state);
+    bool GetSavestateContext(retro_savestate_context* context) const;
     bool GetClearAllThreadWaitsCb(retro_environment_t* env);
+    bool SetFrameTimeCallback(const retro_frame_time_callback* callback);
+    bool SetFastForwardingOverride(const retro_fastforwarding_override* fastforwarding_override);
 };
 }
@@ -0,0 +1,96 @@
+#include "FrameScheduler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <thread>
+
+#if defined(__linux__)
+#include <time.h>
+#else
+#include <SDL3/SDL_timer.h>
+#endif
+
+namespace SK
+{
+static constexpr double s_min_spin_ns = 200000.0;
+static constexpr double s_max_spin_ns = 4000000.0;
+
+void FrameScheduler::SetRate(double fps)
+{
+    if (fps <= 0.0)
+        fps = 60.0;
+
+    m_fps_numerator = std::max<int64_t>(std::llround(fps * s_fps_denominator), 1);
+    m_period_ns = s_fps_denominator * s_ns_per_sec / m_fps_numerator;
+    m_period_remainder = s_fps_denominator * s_ns_per_sec % m_fps_numerator;
+    m_deadline_remainder = 0;
+}
+
+void FrameScheduler::Reset()
+{
+    m_deadline = Clock::now();
+    m_deadline_remainder = 0;
+}
+
+void FrameScheduler::WaitForNextFrame()
+{
+    auto now = Clock::now();
+    if (now >= m_deadline)
+        return;
+
+    double spin_ns = std::clamp(m_oversleep_ns * 1.5, s_min_spin_ns, s_max_spin_ns);
+    auto wake_time = m_deadline - std::chrono::nanoseconds(static_cast<int64_t>(spin_ns));
+    if (now < wake_time)
+    {
+        SleepUntil(wake_time);
+
+        double oversleep_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wake_time).count());
+        m_oversleep_ns = m_oversleep_ns * 0.9 + std::max(oversleep_ns, 0.0) * 0.1;
+    }
+
+    while (Clock::now() < m_deadline)
+        std::this_thread::yield();
+}
+
+void FrameScheduler::Advance()
+{
+    m_deadline += std::chrono::nanoseconds(m_period_ns);
+    m_deadline_remainder += m_period_remainder;
+    if (m_deadline_remainder >= m_fps_numerator)
+    {
+        m_deadline += std::chrono::nanoseconds(1);
+        m_deadline_remainder -= m_fps_numerator;
+    }
+}
+
+uint64_t FrameScheduler::GetFramesBehind() const
+{
+    auto behind = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_deadline).count();
+    if (behind <= 0 || m_period_ns <= 0)
+        return 0;
+    return static_cast<uint64_t>(behind / m_period_ns);
+}
+
+double FrameScheduler::GetFrameDurationSec() const
+{
+    return static_cast<double>(s_fps_denominator) / static_cast<double>(m_fps_numerator);
+}
+
+void FrameScheduler::SleepUntil(Clock::time_point time)
+{
+#if defined(__linux__)
+    // steady_clock is CLOCK_MONOTONIC here, an absolute wake-up avoids accumulating the syscall latency
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    timespec ts = {};
+    ts.tv_sec = static_cast<time_t>(ns / s_ns_per_sec);
+    ts.tv_nsec = static_cast<long>(ns % s_ns_per_sec);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+#else
+    // SDL uses a high resolution waitable timer on Windows
+    auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(time - Clock::now()).count();
+    if (remaining > 0)
+        SDL_DelayNS(static_cast<Uint64>(remaining));
+#endif
+}
+}
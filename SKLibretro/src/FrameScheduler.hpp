@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+namespace SK
+{
+// Paces the emulation thread at the core's fps, sleeping until shortly before each deadline and spinning the rest
+class FrameScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Fractional rates (59.8261 fps) are kept as an exact ratio so deadlines never drift
+    void SetRate(double fps);
+    // Starts counting deadlines from now, used at startup and after anything that paused the timer
+    void Reset();
+
+    // Blocks until the next frame is due, returns immediately while frames are owed
+    void WaitForNextFrame();
+    // Moves the deadline forward by exactly one frame period
+    void Advance();
+
+    // Whole frame periods the current deadline is behind, i.e. frames that are already due after this one
+    uint64_t GetFramesBehind() const;
+    double GetFrameDurationSec() const;
+
+private:
+    static constexpr int64_t s_fps_denominator = 1000000;
+    static constexpr int64_t s_ns_per_sec = 1000000000;
+
+    int64_t m_fps_numerator = 60 * s_fps_denominator;
+    // One frame period is m_period_ns + m_period_remainder / m_fps_numerator nanoseconds
+    int64_t m_period_ns = 0;
+    int64_t m_period_remainder = 0;
+    int64_t m_deadline_remainder = 0;
+    Clock::time_point m_deadline = {};
+
+    // Running estimate of how late the OS wakes us, the spin window is sized from it
+    double m_oversleep_ns = 500000.0;
+
+    void SleepUntil(Clock::time_point time);
+};
+}
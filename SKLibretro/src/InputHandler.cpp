@@ -3,18 +3,24 @@
 #include "Wrapper.hpp"
 #include "Debug.hpp"
 
+#include <algorithm>
+
 namespace SK
 {
 void InputHandler::PollCallback()
 {
+    // Speculative run-ahead frames replay the input of the real frame they follow
+    auto session = Wrapper::GetSession();
+    if (session->input && !session->speculative)
+        session->input->Latch();
 }
 
 int16_t InputHandler::StateCallback(uint32_t port, uint32_t device, uint32_t index, uint32_t id)
 {
-    auto instance = Wrapper::GetInstance();
-    if (!instance)
+    auto input_handler = Wrapper::GetSession()->input;
+    if (!input_handler)
     {
-        LogError("Libretro instance is null.");
+        LogError("StateCallback: No session.");
         return 0;
     }
 
@@ -23,17 +29,17 @@ int16_t InputHandler::StateCallback(uint32_t port, uint32_t device, uint32_t ind
     switch (device)
     {
     case RETRO_DEVICE_JOYPAD:
-        return instance->m_input_handler->ProcessJoypadDevice(port, id);
+        return input_handler->ProcessJoypadDevice(port, id);
     case RETRO_DEVICE_MOUSE:
-        return instance->m_input_handler->ProcessMouseDevice(port, id);
+        return input_handler->ProcessMouseDevice(port, id);
     case RETRO_DEVICE_KEYBOARD:
-        return instance->m_input_handler->ProcessKeyboardDevice(port, id);
+        return input_handler->ProcessKeyboardDevice(port, id);
     case RETRO_DEVICE_LIGHTGUN:
-        return instance->m_input_handler->ProcessLightgunDevice(port, id);
+        return input_handler->ProcessLightgunDevice(port, id);
     case RETRO_DEVICE_POINTER:
-        return instance->m_input_handler->ProcessPointerDevice(port, id);
+        return input_handler->ProcessPointerDevice(port, id);
     case RETRO_DEVICE_ANALOG:
-        return instance->m_input_handler->ProcessAnalogDevice(port, index, id);
+        return input_handler->ProcessAnalogDevice(port, index, id);
     default:
         LogError("Unhandled input device: " + std::to_string(device) + " for port: " + std::to_string(port) + " and id: " + std::to_string(id));
         break;
@@ -52,135 +58,140 @@ bool InputHandler::RumbleInterfaceSetRumbleState(uint32_t port, retro_rumble_eff
 
 void InputHandler::SetJoypadButtonStates(uint32_t port, uint16_t states)
 {
-    m_joypad_buttons[port] = states;
+    if (port < s_max_ports)
+        m_pending.ports[port].joypad_buttons = states;
 }
-uint16_t InputHandler::GetJoypadButtonStates(uint32_t port)
+uint16_t InputHandler::GetJoypadButtonStates(uint32_t port) const
 {
-    return m_joypad_buttons[port];
+    return port < s_max_ports ? m_pending.ports[port].joypad_buttons : 0;
 }
 
-void InputHandler::SetMousePosition(uint32_t port, int16_t x, int16_t y)
+void InputHandler::AddMouseMotion(uint32_t port, int16_t x, int16_t y)
 {
-    m_mouse_x[port] += x;
-    m_mouse_y[port] += y;
+    if (port >= s_max_ports)
+        return;
+    m_mouse_x_accum[port].fetch_add(x, std::memory_order_relaxed);
+    m_mouse_y_accum[port].fetch_add(y, std::memory_order_relaxed);
 }
 void InputHandler::SetMouseButtons(uint32_t port, uint32_t buttons)
 {
-    m_mouse_buttons[port] = buttons;
-}
-uint16_t InputHandler::GetMouseX(uint32_t port)
-{
-    return m_mouse_x[port];
+    if (port < s_max_ports)
+        m_pending.ports[port].mouse_buttons = buttons;
 }
-uint16_t InputHandler::GetMouseY(uint32_t port)
+uint32_t InputHandler::GetMouseButtons(uint32_t port) const
 {
-    return m_mouse_y[port];
-}
-uint32_t InputHandler::GetMouseButtons(uint32_t port)
-{
-    return m_mouse_buttons[port];
+    return port < s_max_ports ? m_pending.ports[port].mouse_buttons : 0;
 }
 
-void InputHandler::SetKeyboardKeys(uint32_t port, uint32_t keys)
+void InputHandler::SetKey(uint32_t keycode, bool down)
 {
-    m_keyboard_keys[port] = keys;
+    if (keycode > RETROK_UNKNOWN && keycode < RETROK_LAST)
+        m_pending.keys.set(keycode, down);
 }
-uint32_t InputHandler::GetKeyboardKeys(uint32_t port)
+
+void InputHandler::QueueKeyEvent(bool down, uint32_t keycode, uint32_t character, uint16_t key_modifiers)
 {
-    return m_keyboard_keys[port];
+    // A full ring means the core stopped polling, the key state in the snapshot still ends up right
+    m_key_events.TryPush({ down, keycode, character, key_modifiers });
 }
 
 void InputHandler::SetLightgunPosition(uint32_t port, int16_t x, int16_t y)
 {
-    m_lightgun_x[port] = x;
-    m_lightgun_y[port] = y;
+    if (port >= s_max_ports)
+        return;
+    m_pending.ports[port].lightgun_x = x;
+    m_pending.ports[port].lightgun_y = y;
 }
 void InputHandler::SetLightgunIsOffscreen(uint32_t port, int16_t is_offscreen)
 {
-    m_lightgun_is_offscreen[port] = is_offscreen;
+    if (port < s_max_ports)
+        m_pending.ports[port].lightgun_is_offscreen = is_offscreen;
 }
 void InputHandler::SetLightgunButtons(uint32_t port, uint32_t buttons)
 {
-    m_lightgun_buttons[port] = buttons;
-}
-int16_t InputHandler::GetLightgunX(uint32_t port)
-{
-    return m_lightgun_x[port];
-}
-int16_t InputHandler::GetLightgunY(uint32_t port)
-{
-    return m_lightgun_y[port];
-}
-int16_t InputHandler::GetLightgunIsOffscreen(uint32_t port)
-{
-    return m_lightgun_is_offscreen[port];
-}
-uint32_t InputHandler::GetLightgunButtons(uint32_t port)
-{
-    return m_lightgun_buttons[port];
+    if (port < s_max_ports)
+        m_pending.ports[port].lightgun_buttons = buttons;
 }
 
 void InputHandler::SetPointerPosition(uint32_t port, int16_t x, int16_t y)
 {
-    m_pointer_x[port] = x;
-    m_pointer_y[port] = y;
+    if (port >= s_max_ports)
+        return;
+    m_pending.ports[port].pointer_x = x;
+    m_pending.ports[port].pointer_y = y;
 }
 void InputHandler::SetPointerPressed(uint32_t port, int16_t pressed)
 {
-    m_pointer_pressed[port] = pressed;
+    if (port < s_max_ports)
+        m_pending.ports[port].pointer_pressed = pressed;
 }
 void InputHandler::SetPointerCount(uint32_t port, int16_t count)
 {
-    m_pointer_count[port] = count;
-}
-int16_t InputHandler::GetPointerX(uint32_t port)
-{
-    return m_pointer_x[port];
-}
-int16_t InputHandler::GetPointerY(uint32_t port)
-{
-    return m_pointer_y[port];
-}
-int16_t InputHandler::GetPointerPressed(uint32_t port)
-{
-    return m_pointer_pressed[port];
-}
-int16_t InputHandler::GetPointerCount(uint32_t port)
-{
-    return m_pointer_count[port];
+    if (port < s_max_ports)
+        m_pending.ports[port].pointer_count = count;
 }
 
 void InputHandler::SetAnalogLeft(uint32_t port, int16_t x, int16_t y)
 {
-    m_analog_left_x[port] = x;
-    m_analog_left_y[port] = y;
+    if (port >= s_max_ports)
+        return;
+    m_pending.ports[port].analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_X] = x;
+    m_pending.ports[port].analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_Y] = y;
 }
 void InputHandler::SetAnalogRight(uint32_t port, int16_t x, int16_t y)
 {
-    m_analog_right_x[port] = x;
-    m_analog_right_y[port] = y;
+    if (port >= s_max_ports)
+        return;
+    m_pending.ports[port].analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_X] = x;
+    m_pending.ports[port].analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_Y] = y;
 }
-int16_t InputHandler::GetAnalogLeftX(uint32_t port)
-{
-    return m_analog_left_x[port];
-}
-int16_t InputHandler::GetAnalogLeftY(uint32_t port)
+
+void InputHandler::ClearPending()
 {
-    return m_analog_left_y[port];
+    // Cores following the keyboard callback rather than the state need to hear about the release too
+    for (uint32_t keycode = RETROK_UNKNOWN + 1; keycode < RETROK_LAST; keycode++)
+        if (m_pending.keys.test(keycode))
+            QueueKeyEvent(false, keycode, 0, 0);
+
+    m_pending = {};
+    for (uint32_t port = 0; port < s_max_ports; port++)
+    {
+        m_mouse_x_accum[port].store(0, std::memory_order_relaxed);
+        m_mouse_y_accum[port].store(0, std::memory_order_relaxed);
+    }
 }
-int16_t InputHandler::GetAnalogRightX(uint32_t port)
+
+void InputHandler::Publish()
 {
-    return m_analog_right_x[port];
+    m_snapshots[m_write_index] = m_pending;
+    m_write_index = m_middle.exchange(m_write_index | s_fresh, std::memory_order_acq_rel) & ~s_fresh;
 }
-int16_t InputHandler::GetAnalogRightY(uint32_t port)
+
+void InputHandler::Latch()
 {
-    return m_analog_right_y[port];
+    if (m_middle.load(std::memory_order_relaxed) & s_fresh)
+        m_read_index = m_middle.exchange(m_read_index, std::memory_order_acq_rel) & ~s_fresh;
+
+    // Motion isn't part of the snapshot, whatever arrived since the last poll belongs to this frame
+    Snapshot& latched = m_snapshots[m_read_index];
+    for (uint32_t port = 0; port < s_max_ports; port++)
+    {
+        latched.ports[port].mouse_x = static_cast<int16_t>(std::clamp<int32_t>(m_mouse_x_accum[port].exchange(0, std::memory_order_relaxed), INT16_MIN, INT16_MAX));
+        latched.ports[port].mouse_y = static_cast<int16_t>(std::clamp<int32_t>(m_mouse_y_accum[port].exchange(0, std::memory_order_relaxed), INT16_MIN, INT16_MAX));
+    }
+
+    while (KeyEvent* key_event = m_key_events.Front())
+    {
+        if (m_keyboard_event)
+            m_keyboard_event(key_event->down, key_event->keycode, key_event->character, key_event->key_modifiers);
+        m_key_events.Pop();
+    }
 }
 
-void InputHandler::CallKeyboardEventCallback(bool down, uint32_t keycode, uint32_t character, uint16_t keyModifiers)
+const InputHandler::PortState& InputHandler::GetLatchedPort(uint32_t port) const
 {
-    if (m_keyboard_event)
-        m_keyboard_event(down, keycode, character, keyModifiers);
+    static const PortState s_idle = {};
+    return port < s_max_ports ? m_snapshots[m_read_index].ports[port] : s_idle;
 }
 
 bool InputHandler::SetInputDescriptors(const retro_input_descriptor* input_descriptors)
@@ -281,66 +292,60 @@ bool InputHandler::SetKeyboardEventCallback(const retro_keyboard_callback* keybo
 
 int16_t InputHandler::ProcessJoypadDevice(uint32_t port, uint32_t id)
 {
+    uint16_t buttons = GetLatchedPort(port).joypad_buttons;
     if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
-        return m_joypad_buttons[port];
-    return m_joypad_buttons[port] & (1 << id);
+        return static_cast<int16_t>(buttons);
+    return id < 16 ? (buttons >> id) & 1 : 0;
 }
 
 int16_t InputHandler::ProcessMouseDevice(uint32_t port, uint32_t id)
 {
+    const PortState& state = GetLatchedPort(port);
     switch (id)
     {
     case RETRO_DEVICE_ID_MOUSE_X:
-    {
-        int16_t dx = m_mouse_x[port];
-        m_mouse_x[port] = 0;
-        return dx;
-    }
-    break;
+        return state.mouse_x;
     case RETRO_DEVICE_ID_MOUSE_Y:
-    {
-        int16_t dy = m_mouse_y[port];
-        m_mouse_y[port] = 0;
-        return dy;
-    }
-    break;
+        return state.mouse_y;
     default:
-        return m_mouse_buttons[port] & (1 << id);
+        return id < 32 ? (state.mouse_buttons >> id) & 1 : 0;
     }
 }
 
 int16_t InputHandler::ProcessKeyboardDevice(uint32_t port, uint32_t id)
 {
-    return m_keyboard_keys[port] & (1 << id);
+    return id < RETROK_LAST && m_snapshots[m_read_index].keys.test(id);
 }
 
 int16_t InputHandler::ProcessLightgunDevice(uint32_t port, uint32_t id)
 {
+    const PortState& state = GetLatchedPort(port);
     switch (id)
     {
         case RETRO_DEVICE_ID_LIGHTGUN_SCREEN_X:
-            return m_lightgun_x[port];
+            return state.lightgun_x;
         case RETRO_DEVICE_ID_LIGHTGUN_SCREEN_Y:
-            return m_lightgun_y[port];
+            return state.lightgun_y;
         case RETRO_DEVICE_ID_LIGHTGUN_IS_OFFSCREEN:
-            return m_lightgun_is_offscreen[port];
+            return state.lightgun_is_offscreen;
         default:
-            return m_lightgun_buttons[port] & (1 << id);
+            return id < 32 ? (state.lightgun_buttons >> id) & 1 : 0;
     }
 }
 
 int16_t InputHandler::ProcessPointerDevice(uint32_t port, uint32_t id)
 {
+    const PortState& state = GetLatchedPort(port);
     switch (id)
     {
         case RETRO_DEVICE_ID_POINTER_X:
-            return m_pointer_x[port];
+            return state.pointer_x;
         case RETRO_DEVICE_ID_POINTER_Y:
-            return m_pointer_y[port];
+            return state.pointer_y;
         case RETRO_DEVICE_ID_POINTER_PRESSED:
-            return m_pointer_pressed[port];
+            return state.pointer_pressed;
         case RETRO_DEVICE_ID_POINTER_COUNT:
-            return m_pointer_count[port];
+            return state.pointer_count;
         default:
             return 0;
     }
@@ -348,30 +353,8 @@ int16_t InputHandler::ProcessPointerDevice(uint32_t port, uint32_t id)
 
 int16_t InputHandler::ProcessAnalogDevice(uint32_t port, uint32_t index, uint32_t id)
 {
-    switch (index)
-    {
-        case RETRO_DEVICE_INDEX_ANALOG_LEFT:
-            switch (id)
-            {
-                case RETRO_DEVICE_ID_ANALOG_X:
-                    return m_analog_left_x[port];
-                case RETRO_DEVICE_ID_ANALOG_Y:
-                    return m_analog_left_y[port];
-                default:
-                    return 0;
-            }
-        case RETRO_DEVICE_INDEX_ANALOG_RIGHT:
-            switch (id)
-            {
-                case RETRO_DEVICE_ID_ANALOG_X:
-                    return m_analog_right_x[port];
-                case RETRO_DEVICE_ID_ANALOG_Y:
-                    return m_analog_right_y[port];
-                default:
-                    return 0;
-            }
-        default:
-            return 0;
-    }
+    if (index > RETRO_DEVICE_INDEX_ANALOG_RIGHT || id > RETRO_DEVICE_ID_ANALOG_Y)
+        return 0;
+    return GetLatchedPort(port).analog[index][id];
 }
 }
@@ -3,10 +3,14 @@
 #include <cstdint>
 #include <string>
 #include <vector>
-#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <bitset>
 
 #include <libretro.h>
 
+#include "CommandRing.hpp"
+
 namespace SK
 {
 class InputHandler
@@ -31,43 +35,61 @@ public:
         std::string description;
     };
 
+    static constexpr uint32_t s_max_ports = 4;
+
+    // Everything a core can read for one port, copied as a whole when published
+    struct alignas(64) PortState
+    {
+        uint16_t joypad_buttons = 0;
+        int16_t analog[2][2] = {};
+        uint32_t mouse_buttons = 0;
+        int16_t lightgun_x = 0;
+        int16_t lightgun_y = 0;
+        int16_t lightgun_is_offscreen = 0;
+        uint32_t lightgun_buttons = 0;
+        int16_t pointer_x = 0;
+        int16_t pointer_y = 0;
+        int16_t pointer_pressed = 0;
+        int16_t pointer_count = 0;
+        // Relative motion accumulated since the previous latch
+        int16_t mouse_x = 0;
+        int16_t mouse_y = 0;
+    };
+
+    // Main thread, the setters only touch the pending state until Publish hands it to the emulation thread
     void SetJoypadButtonStates(uint32_t port, uint16_t states);
-    uint16_t GetJoypadButtonStates(uint32_t port);
+    uint16_t GetJoypadButtonStates(uint32_t port) const;
 
-    void SetMousePosition(uint32_t port, int16_t x, int16_t y);
-    uint16_t GetMouseX(uint32_t port);
-    uint16_t GetMouseY(uint32_t port);
+    void AddMouseMotion(uint32_t port, int16_t x, int16_t y);
     void SetMouseButtons(uint32_t port, uint32_t buttons);
-    uint32_t GetMouseButtons(uint32_t port);
+    uint32_t GetMouseButtons(uint32_t port) const;
 
-    void SetKeyboardKeys(uint32_t port, uint32_t keys);
-    uint32_t GetKeyboardKeys(uint32_t port);
+    // Keyboard state isn't per port, cores read it from whichever port they like
+    void SetKey(uint32_t keycode, bool down);
+    // Delivered to the core's keyboard callback on the emulation thread at the next Latch
+    void QueueKeyEvent(bool down, uint32_t keycode, uint32_t character, uint16_t key_modifiers);
 
     void SetLightgunPosition(uint32_t port, int16_t x, int16_t y);
-    int16_t GetLightgunX(uint32_t port);
-    int16_t GetLightgunY(uint32_t port);
     void SetLightgunIsOffscreen(uint32_t port, int16_t is_offscreen);
-    int16_t GetLightgunIsOffscreen(uint32_t port);
     void SetLightgunButtons(uint32_t port, uint32_t buttons);
-    uint32_t GetLightgunButtons(uint32_t port);
 
     void SetPointerPosition(uint32_t port, int16_t x, int16_t y);
-    int16_t GetPointerX(uint32_t port);
-    int16_t GetPointerY(uint32_t port);
     void SetPointerPressed(uint32_t port, int16_t pressed);
-    int16_t GetPointerPressed(uint32_t port);
     void SetPointerCount(uint32_t port, int16_t count);
-    int16_t GetPointerCount(uint32_t port);
 
     void SetAnalogLeft(uint32_t port, int16_t x, int16_t y);
-    int16_t GetAnalogLeftX(uint32_t port);
-    int16_t GetAnalogLeftY(uint32_t port);
     void SetAnalogRight(uint32_t port, int16_t x, int16_t y);
-    int16_t GetAnalogRightX(uint32_t port);
-    int16_t GetAnalogRightY(uint32_t port);
+
+    // Main thread, releases everything held on every port and the keyboard, still needs a Publish
+    void ClearPending();
+    // Main thread, once per Godot frame
+    void Publish();
+    // Emulation thread, picks up the newest published snapshot if there is one and runs queued key events. Called from PollCallback
+    void Latch();
+    // Emulation thread, what the core sees until the next Latch
+    const PortState& GetLatchedPort(uint32_t port) const;
 
     bool SetKeyboardEventCallback(const retro_keyboard_callback* keyboard_callback);
-    void CallKeyboardEventCallback(bool down, uint32_t keycode, uint32_t character, uint16_t keyModifiers);
 
     bool SetInputDescriptors(const retro_input_descriptor* input_descriptors);
     bool SetControllerInfo(const retro_controller_info* controller_info);
@@ -76,28 +98,31 @@ public:
     bool GetInputBitmasks(bool* available);
 
 private:
-    std::unordered_map<uint32_t, uint16_t> m_joypad_buttons;
-
-    std::unordered_map<uint32_t, int16_t> m_mouse_x;
-    std::unordered_map<uint32_t, int16_t> m_mouse_y;
-    std::unordered_map<uint32_t, uint32_t> m_mouse_buttons;
-
-    std::unordered_map<uint32_t, uint32_t> m_keyboard_keys;
-
-    std::unordered_map<uint32_t, int16_t> m_lightgun_x;
-    std::unordered_map<uint32_t, int16_t> m_lightgun_y;
-    std::unordered_map<uint32_t, int16_t> m_lightgun_is_offscreen;
-    std::unordered_map<uint32_t, uint32_t> m_lightgun_buttons;
+    struct Snapshot
+    {
+        std::array<PortState, s_max_ports> ports = {};
+        std::bitset<RETROK_LAST> keys;
+    };
 
-    std::unordered_map<uint32_t, int16_t> m_pointer_x;
-    std::unordered_map<uint32_t, int16_t> m_pointer_y;
-    std::unordered_map<uint32_t, int16_t> m_pointer_pressed;
-    std::unordered_map<uint32_t, int16_t> m_pointer_count;
+    struct KeyEvent
+    {
+        bool down = false;
+        uint32_t keycode = RETROK_UNKNOWN;
+        uint32_t character = 0;
+        uint16_t key_modifiers = 0;
+    };
 
-    std::unordered_map<uint32_t, int16_t> m_analog_left_x;
-    std::unordered_map<uint32_t, int16_t> m_analog_left_y;
-    std::unordered_map<uint32_t, int16_t> m_analog_right_x;
-    std::unordered_map<uint32_t, int16_t> m_analog_right_y;
+    // Triple buffer: the main thread owns one slot, the emulation thread another, the third is handed over through m_middle
+    static constexpr uint32_t s_fresh = 4;
+    Snapshot m_pending = {};
+    std::array<Snapshot, 3> m_snapshots = {};
+    uint32_t m_write_index = 0;
+    uint32_t m_read_index = 1;
+    alignas(64) std::atomic<uint32_t> m_middle = 2;
+    // Deltas are summed rather than overwritten so motion between two latches is never lost
+    std::array<std::atomic<int32_t>, s_max_ports> m_mouse_x_accum = {};
+    std::array<std::atomic<int32_t>, s_max_ports> m_mouse_y_accum = {};
+    CommandRing<KeyEvent, 256> m_key_events;
 
     std::vector<std::vector<RetroController>> m_controllers;
     std::vector<RetroDevice> m_devices;
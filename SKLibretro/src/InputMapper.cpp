@@ -0,0 +1,143 @@
+#include "InputMapper.hpp"
+
+#include <godot_cpp/classes/input.hpp>
+#include <godot_cpp/classes/global_constants.hpp>
+#include <godot_cpp/core/math.hpp>
+
+using namespace godot;
+
+namespace SK
+{
+struct JoypadButtonMapping
+{
+    JoyButton godot;
+    uint32_t retro;
+};
+
+// Positional, the bottom face button is B like on a SNES pad
+static constexpr JoypadButtonMapping s_joypad_buttons[] =
+{
+    { JOY_BUTTON_A,              RETRO_DEVICE_ID_JOYPAD_B },
+    { JOY_BUTTON_B,              RETRO_DEVICE_ID_JOYPAD_A },
+    { JOY_BUTTON_X,              RETRO_DEVICE_ID_JOYPAD_Y },
+    { JOY_BUTTON_Y,              RETRO_DEVICE_ID_JOYPAD_X },
+    { JOY_BUTTON_BACK,           RETRO_DEVICE_ID_JOYPAD_SELECT },
+    { JOY_BUTTON_START,          RETRO_DEVICE_ID_JOYPAD_START },
+    { JOY_BUTTON_DPAD_UP,        RETRO_DEVICE_ID_JOYPAD_UP },
+    { JOY_BUTTON_DPAD_DOWN,      RETRO_DEVICE_ID_JOYPAD_DOWN },
+    { JOY_BUTTON_DPAD_LEFT,      RETRO_DEVICE_ID_JOYPAD_LEFT },
+    { JOY_BUTTON_DPAD_RIGHT,     RETRO_DEVICE_ID_JOYPAD_RIGHT },
+    { JOY_BUTTON_LEFT_SHOULDER,  RETRO_DEVICE_ID_JOYPAD_L },
+    { JOY_BUTTON_RIGHT_SHOULDER, RETRO_DEVICE_ID_JOYPAD_R },
+    { JOY_BUTTON_LEFT_STICK,     RETRO_DEVICE_ID_JOYPAD_L3 },
+    { JOY_BUTTON_RIGHT_STICK,    RETRO_DEVICE_ID_JOYPAD_R3 },
+};
+
+static constexpr float s_trigger_threshold = 0.5f;
+
+static int16_t ToAxis(float value)
+{
+    return static_cast<int16_t>(Math::round(Math::clamp(value, -1.0f, 1.0f) * 0x7fff));
+}
+
+InputMapper::InputMapper()
+: m_button_actions
+{ {
+    { "RETRO_JOYPAD_B",      RETRO_DEVICE_ID_JOYPAD_B },
+    { "RETRO_JOYPAD_Y",      RETRO_DEVICE_ID_JOYPAD_Y },
+    { "RETRO_JOYPAD_SELECT", RETRO_DEVICE_ID_JOYPAD_SELECT },
+    { "RETRO_JOYPAD_START",  RETRO_DEVICE_ID_JOYPAD_START },
+    { "RETRO_JOYPAD_UP",     RETRO_DEVICE_ID_JOYPAD_UP },
+    { "RETRO_JOYPAD_DOWN",   RETRO_DEVICE_ID_JOYPAD_DOWN },
+    { "RETRO_JOYPAD_LEFT",   RETRO_DEVICE_ID_JOYPAD_LEFT },
+    { "RETRO_JOYPAD_RIGHT",  RETRO_DEVICE_ID_JOYPAD_RIGHT },
+    { "RETRO_JOYPAD_A",      RETRO_DEVICE_ID_JOYPAD_A },
+    { "RETRO_JOYPAD_X",      RETRO_DEVICE_ID_JOYPAD_X },
+    { "RETRO_JOYPAD_L",      RETRO_DEVICE_ID_JOYPAD_L },
+    { "RETRO_JOYPAD_R",      RETRO_DEVICE_ID_JOYPAD_R },
+    { "RETRO_JOYPAD_L2",     RETRO_DEVICE_ID_JOYPAD_L2 },
+    { "RETRO_JOYPAD_R2",     RETRO_DEVICE_ID_JOYPAD_R2 },
+    { "RETRO_JOYPAD_L3",     RETRO_DEVICE_ID_JOYPAD_L3 },
+    { "RETRO_JOYPAD_R3",     RETRO_DEVICE_ID_JOYPAD_R3 },
+} }
+// The *_Y_POSITIVE actions point up, libretro's Y axis points down
+, m_left_stick{ "RETRO_ANALOG_LEFT_X_NEGATIVE", "RETRO_ANALOG_LEFT_X_POSITIVE", "RETRO_ANALOG_LEFT_Y_POSITIVE", "RETRO_ANALOG_LEFT_Y_NEGATIVE" }
+, m_right_stick{ "RETRO_ANALOG_RIGHT_X_NEGATIVE", "RETRO_ANALOG_RIGHT_X_POSITIVE", "RETRO_ANALOG_RIGHT_Y_POSITIVE", "RETRO_ANALOG_RIGHT_Y_NEGATIVE" }
+{
+}
+
+void InputMapper::Update(InputHandler& input_handler, const PortDevices& port_devices)
+{
+    Array connected_joypads;
+    bool joypads_queried = false;
+
+    for (uint32_t port = 0; port < InputHandler::s_max_ports; port++)
+    {
+        int32_t device = port_devices[port];
+        if (device == s_actions_device)
+        {
+            UpdateFromActions(input_handler, port);
+            continue;
+        }
+
+        if (device >= 0)
+        {
+            if (!joypads_queried)
+            {
+                connected_joypads = Input::get_singleton()->get_connected_joypads();
+                joypads_queried = true;
+            }
+            if (connected_joypads.has(device))
+            {
+                UpdateFromJoypad(input_handler, port, device);
+                continue;
+            }
+        }
+
+        // Unbound or unplugged, whatever was held when that happened must not stay pressed
+        ClearPort(input_handler, port);
+    }
+}
+
+void InputMapper::ClearPort(InputHandler& input_handler, uint32_t port)
+{
+    input_handler.SetJoypadButtonStates(port, 0);
+    input_handler.SetAnalogLeft(port, 0, 0);
+    input_handler.SetAnalogRight(port, 0, 0);
+}
+
+void InputMapper::UpdateFromActions(InputHandler& input_handler, uint32_t port)
+{
+    auto input = Input::get_singleton();
+
+    uint16_t joypad_buttons = 0;
+    for (const ButtonAction& button : m_button_actions)
+        joypad_buttons |= static_cast<uint16_t>(input->is_action_pressed(button.action)) << button.id;
+    input_handler.SetJoypadButtonStates(port, joypad_buttons);
+
+    // get_vector keeps the analog strength and already limits keyboard diagonals to the unit circle
+    Vector2 left = input->get_vector(m_left_stick.negative_x, m_left_stick.positive_x, m_left_stick.negative_y, m_left_stick.positive_y);
+    input_handler.SetAnalogLeft(port, ToAxis(left.x), ToAxis(left.y));
+
+    Vector2 right = input->get_vector(m_right_stick.negative_x, m_right_stick.positive_x, m_right_stick.negative_y, m_right_stick.positive_y);
+    input_handler.SetAnalogRight(port, ToAxis(right.x), ToAxis(right.y));
+}
+
+void InputMapper::UpdateFromJoypad(InputHandler& input_handler, uint32_t port, int32_t device)
+{
+    auto input = Input::get_singleton();
+
+    uint16_t joypad_buttons = 0;
+    for (const JoypadButtonMapping& button : s_joypad_buttons)
+        joypad_buttons |= static_cast<uint16_t>(input->is_joy_button_pressed(device, button.godot)) << button.retro;
+    if (input->get_joy_axis(device, JOY_AXIS_TRIGGER_LEFT) > s_trigger_threshold)
+        joypad_buttons |= 1 << RETRO_DEVICE_ID_JOYPAD_L2;
+    if (input->get_joy_axis(device, JOY_AXIS_TRIGGER_RIGHT) > s_trigger_threshold)
+        joypad_buttons |= 1 << RETRO_DEVICE_ID_JOYPAD_R2;
+    input_handler.SetJoypadButtonStates(port, joypad_buttons);
+
+    // Godot's stick axes already point the way libretro's do, down and right positive
+    input_handler.SetAnalogLeft(port, ToAxis(input->get_joy_axis(device, JOY_AXIS_LEFT_X)), ToAxis(input->get_joy_axis(device, JOY_AXIS_LEFT_Y)));
+    input_handler.SetAnalogRight(port, ToAxis(input->get_joy_axis(device, JOY_AXIS_RIGHT_X)), ToAxis(input->get_joy_axis(device, JOY_AXIS_RIGHT_Y)));
+}
+}
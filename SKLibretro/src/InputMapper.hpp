@@ -0,0 +1,53 @@
+#pragma once
+
+#include <godot_cpp/variant/string_name.hpp>
+
+#include <cstdint>
+#include <array>
+
+#include "InputHandler.hpp"
+
+namespace SK
+{
+// Turns Godot's input state into libretro port state once per frame, main thread only
+// Port 0 follows the RETRO_* actions from the InputMap unless it is bound to a joypad, other ports read their bound joypad directly
+class InputMapper
+{
+public:
+    // Ports using the RETRO_* actions
+    static constexpr int32_t s_actions_device = -1;
+    // Ports that stay idle
+    static constexpr int32_t s_unbound_device = -2;
+
+    using PortDevices = std::array<int32_t, InputHandler::s_max_ports>;
+    static constexpr PortDevices s_default_port_devices = { s_actions_device, s_unbound_device, s_unbound_device, s_unbound_device };
+
+    InputMapper();
+
+    void Update(InputHandler& input_handler, const PortDevices& port_devices);
+
+private:
+    struct ButtonAction
+    {
+        godot::StringName action;
+        uint32_t id;
+    };
+
+    struct StickActions
+    {
+        godot::StringName negative_x;
+        godot::StringName positive_x;
+        godot::StringName negative_y;
+        godot::StringName positive_y;
+    };
+
+    // Interned once, building a StringName from a literal on every query is what made polling expensive
+    std::array<ButtonAction, 16> m_button_actions;
+    StickActions m_left_stick;
+    StickActions m_right_stick;
+
+    void UpdateFromActions(InputHandler& input_handler, uint32_t port);
+    void UpdateFromJoypad(InputHandler& input_handler, uint32_t port, int32_t device);
+    void ClearPort(InputHandler& input_handler, uint32_t port);
+};
+}
@@ -1,5 +1,10 @@
 #include "Libretro.hpp"
 
+#include <godot_cpp/classes/performance.hpp>
+#include <godot_cpp/variant/packed_int64_array.hpp>
+
+#include <algorithm>
+
 #include "Wrapper.hpp"
 
 using namespace godot;
@@ -8,6 +13,8 @@ namespace SK
 {
 Libretro* Libretro::m_instance = nullptr;
 
+static const char* s_audio_monitors[] = { "underruns", "dropped_frames", "fill_percent", "produced_frames_per_sec", "consumed_frames_per_sec", "effective_sample_rate" };
+
 Libretro::Libretro()
 {
     if (m_instance)
@@ -36,14 +43,237 @@ void Libretro::StopContent()
     Wrapper::GetInstance()->StopContent();
 }
 
+void Libretro::LoadContent(String game_path)
+{
+    Wrapper::GetInstance()->LoadContent(game_path.utf8().get_data());
+}
+
+void Libretro::Reset()
+{
+    Wrapper::GetInstance()->Reset();
+}
+
 void Libretro::SetCoreOption(const godot::String& key, const godot::String& value)
 {
     Wrapper::GetInstance()->SetCoreOption(key.utf8().get_data(), value.utf8().get_data());
 }
 
+void Libretro::SetPacingMode(int32_t mode, float audio_target_fill)
+{
+    Wrapper::GetInstance()->SetPacingMode(static_cast<PacingMode>(mode), audio_target_fill);
+}
+
+void Libretro::SetAudioDspFilter(const godot::String& path)
+{
+    Wrapper::GetInstance()->SetAudioDspFilter(path.utf8().get_data());
+}
+
+void Libretro::SetAudioLatency(float latency_sec)
+{
+    Wrapper::GetInstance()->SetAudioLatency(latency_sec);
+}
+
+void Libretro::SetAudioResamplerQuality(int32_t quality)
+{
+    Wrapper::GetInstance()->SetAudioResamplerQuality(quality);
+}
+
+void Libretro::SetFastForward(float ratio)
+{
+    Wrapper::GetInstance()->SetFastForward(ratio);
+}
+
+void Libretro::Pause()
+{
+    Wrapper::GetInstance()->Pause();
+}
+
+void Libretro::Resume()
+{
+    Wrapper::GetInstance()->Resume();
+}
+
+void Libretro::StepFrames(uint32_t count)
+{
+    Wrapper::GetInstance()->StepFrames(count);
+}
+
+bool Libretro::IsPaused()
+{
+    return Wrapper::GetInstance()->IsPaused();
+}
+
+void Libretro::SetSlowMotion(float factor)
+{
+    Wrapper::GetInstance()->SetSlowMotion(factor);
+}
+
+void Libretro::SetMaxCatchUpFrames(uint32_t count)
+{
+    Wrapper::GetInstance()->SetMaxCatchUpFrames(count);
+}
+
+void Libretro::SetThreadPriority(int32_t priority)
+{
+    Wrapper::GetInstance()->SetThreadPriority(static_cast<ThreadPriority>(Math::clamp(priority, 0, 3)));
+}
+
+void Libretro::SetThreadAffinity(int64_t affinity_mask)
+{
+    Wrapper::GetInstance()->SetThreadAffinity(static_cast<uint64_t>(affinity_mask));
+}
+
+void Libretro::SetJitAllowed(bool allowed)
+{
+    Wrapper::GetInstance()->SetJitAllowed(allowed);
+}
+
+void Libretro::SetOutOfProcess(bool out_of_process)
+{
+    Wrapper::GetInstance()->SetOutOfProcess(out_of_process);
+}
+
+void Libretro::SetPortDevice(int32_t port, int32_t device)
+{
+    Wrapper::GetInstance()->SetPortDevice(static_cast<uint32_t>(port), device);
+}
+
+void Libretro::SetRunAhead(int32_t frames, bool second_instance)
+{
+    Wrapper::GetInstance()->SetRunAhead(static_cast<uint32_t>(std::max(frames, 0)), second_instance);
+}
+
+Dictionary Libretro::GetFrameStats()
+{
+    return MakeFrameStats(*Wrapper::GetInstance());
+}
+
+Dictionary Libretro::MakeFrameStats(Wrapper& wrapper)
+{
+    Dictionary result;
+    auto instance = &wrapper;
+    result["frames_run"] = static_cast<int64_t>(instance->m_frames_run.load(std::memory_order_relaxed));
+    result["skipped_frames"] = static_cast<int64_t>(instance->m_skipped_frames.load(std::memory_order_relaxed));
+    result["dropped_frames"] = static_cast<int64_t>(instance->m_dropped_frames.load(std::memory_order_relaxed));
+    result["content_start_usec"] = static_cast<int64_t>(instance->m_content_start_usec.load(std::memory_order_relaxed));
+    result["content_switch_usec"] = static_cast<int64_t>(instance->m_content_switch_usec.load(std::memory_order_relaxed));
+    result["run_usec"] = instance->m_run_usec.load(std::memory_order_relaxed);
+    result["ipc_overhead_usec"] = instance->m_ipc_overhead_usec.load(std::memory_order_relaxed);
+    result["host_restarts"] = static_cast<int64_t>(instance->m_host_restarts.load(std::memory_order_relaxed));
+    result["run_ahead_usec"] = instance->m_run_ahead.GetRunAheadUsec();
+    result["serialize_usec"] = instance->m_run_ahead.GetSerializeUsec();
+    result["unserialize_usec"] = instance->m_run_ahead.GetUnserializeUsec();
+    result["savestate_size"] = static_cast<int64_t>(instance->m_run_ahead.GetStateSize());
+    result["run_ahead_second_instance"] = instance->m_run_ahead.IsUsingSecondInstance();
+    return result;
+}
+
+void Libretro::SetCommandBudget(int64_t budget_usec)
+{
+    Wrapper::GetInstance()->SetCommandBudget(static_cast<uint32_t>(std::max<int64_t>(budget_usec, 0)));
+}
+
+Dictionary Libretro::GetCommandStats()
+{
+    Dictionary result;
+    auto instance = Wrapper::GetInstance();
+    result["queue_depth"]      = static_cast<int64_t>(instance->m_command_queue_depth.load(std::memory_order_relaxed));
+    result["queue_peak_depth"] = static_cast<int64_t>(instance->m_command_queue_peak_depth.load(std::memory_order_relaxed));
+    result["queue_capacity"]   = static_cast<int64_t>(instance->m_main_thread_commands.GetCapacity());
+    result["drain_usec"]       = static_cast<int64_t>(instance->m_command_drain_usec.load(std::memory_order_relaxed));
+    result["drain_peak_usec"]  = static_cast<int64_t>(instance->m_command_drain_peak_usec.load(std::memory_order_relaxed));
+    result["executed"]         = static_cast<int64_t>(instance->m_commands_executed.load(std::memory_order_relaxed));
+    result["coalesced"]        = static_cast<int64_t>(instance->m_commands_coalesced.load(std::memory_order_relaxed));
+    result["deferred"]         = static_cast<int64_t>(instance->m_commands_deferred.load(std::memory_order_relaxed));
+    result["dropped"]          = static_cast<int64_t>(instance->m_commands_dropped.load(std::memory_order_relaxed));
+    return result;
+}
+
+Dictionary Libretro::GetAudioDspCost()
+{
+    Dictionary result;
+    auto& audio_handler = Wrapper::GetInstance()->m_audio_handler;
+    result["last_usec"]    = audio_handler ? audio_handler->GetDspLastFrameCostUsec() : 0.0;
+    result["average_usec"] = audio_handler ? audio_handler->GetDspAverageFrameCostUsec() : 0.0;
+    result["max_usec"]     = audio_handler ? audio_handler->GetDspMaxFrameCostUsec() : 0.0;
+    return result;
+}
+
+Dictionary Libretro::GetAudioStats()
+{
+    return MakeAudioStats(*Wrapper::GetInstance());
+}
+
+Dictionary Libretro::MakeAudioStats(Wrapper& wrapper)
+{
+    Dictionary result;
+    auto& audio_handler = wrapper.m_audio_handler;
+    AudioStats stats = audio_handler ? audio_handler->GetStats() : AudioStats();
+
+    PackedInt64Array fill_histogram;
+    fill_histogram.resize(stats.fill_histogram.size());
+    for (size_t i = 0; i < stats.fill_histogram.size(); i++)
+        fill_histogram.set(i, static_cast<int64_t>(stats.fill_histogram[i]));
+
+    result["underruns"]               = static_cast<int64_t>(stats.underruns);
+    result["dropped_frames"]          = static_cast<int64_t>(stats.dropped_frames);
+    result["fill_percent"]            = stats.fill_percent;
+    result["fill_histogram"]          = fill_histogram;
+    result["produced_frames_per_sec"] = stats.produced_frames_per_sec;
+    result["consumed_frames_per_sec"] = stats.consumed_frames_per_sec;
+    result["effective_sample_rate"]   = stats.effective_sample_rate;
+    result["output_sample_rate"]      = stats.output_sample_rate;
+    result["buffer_capacity_sec"]     = stats.buffer_capacity_sec;
+    return result;
+}
+
+double Libretro::GetAudioMonitor(const String& key) const
+{
+    auto& audio_handler = Wrapper::GetInstance()->m_audio_handler;
+    if (!audio_handler)
+        return 0.0;
+
+    AudioStats stats = audio_handler->GetStats();
+    if (key == "underruns")               return static_cast<double>(stats.underruns);
+    if (key == "dropped_frames")          return static_cast<double>(stats.dropped_frames);
+    if (key == "fill_percent")            return stats.fill_percent;
+    if (key == "produced_frames_per_sec") return stats.produced_frames_per_sec;
+    if (key == "consumed_frames_per_sec") return stats.consumed_frames_per_sec;
+    if (key == "effective_sample_rate")   return stats.effective_sample_rate;
+    return 0.0;
+}
+
+void Libretro::_enter_tree()
+{
+    if (m_instance != this)
+        return;
+
+    auto performance = Performance::get_singleton();
+    for (auto key : s_audio_monitors)
+    {
+        Array args;
+        args.append(String(key));
+        StringName id = String("SKLibretro/Audio/") + key;
+        if (!performance->has_custom_monitor(id))
+            performance->add_custom_monitor(id, Callable(this, "GetAudioMonitor"), args);
+    }
+}
+
 void Libretro::_exit_tree()
 {
-    StopContent();
+    // Nothing may outlive the tree, so this one stop has to wait
+    Wrapper::GetInstance()->StopContent(true);
+
+    if (m_instance == this)
+    {
+        auto performance = Performance::get_singleton();
+        for (auto key : s_audio_monitors)
+        {
+            StringName id = String("SKLibretro/Audio/") + key;
+            if (performance->has_custom_monitor(id))
+                performance->remove_custom_monitor(id);
+        }
+    }
 
     if (m_instance == this)
         m_instance = nullptr;
@@ -59,21 +289,31 @@ void Libretro::_process(double delta)
     Wrapper::GetInstance()->_process(delta);
 }
 
-void Libretro::NotifyOptionsReady()
+void Libretro::NotifyOptionsReady(Wrapper& wrapper)
+{
+    Object* target = wrapper.m_owner ? wrapper.m_owner : m_instance;
+    if (!target)
+        return;
+
+    auto categories     = GetOptionCategories(wrapper);
+    auto definitions    = GetOptionDefinitions(wrapper);
+    auto current_values = GetOptionValues(wrapper);
+    target->call_deferred("emit_signal", "options_ready", categories, definitions, current_values);
+}
+
+void Libretro::NotifyContentStopped(Wrapper& wrapper)
 {
-    if (!m_instance)
+    Object* target = wrapper.m_owner ? wrapper.m_owner : m_instance;
+    if (!target)
         return;
 
-    auto categories     = m_instance->GetOptionCategories();
-    auto definitions    = m_instance->GetOptionDefinitions();
-    auto current_values = m_instance->GetOptionValues();
-    m_instance->call_deferred("emit_signal", "options_ready", categories, definitions, current_values);
+    target->call_deferred("emit_signal", "content_stopped");
 }
 
-Dictionary Libretro::GetOptionCategories()
+Dictionary Libretro::GetOptionCategories(Wrapper& wrapper)
 {
     Dictionary result;
-    const auto& categories = Wrapper::GetInstance()->GetOptionCategories();
+    const auto& categories = wrapper.GetOptionCategories();
     for (const auto& [key, value] : categories)
     {
         Ref<LibretroOptionCategory> category = memnew(LibretroOptionCategory);
@@ -84,10 +324,10 @@ Dictionary Libretro::GetOptionCategories()
     return result;
 }
 
-Dictionary Libretro::GetOptionDefinitions()
+Dictionary Libretro::GetOptionDefinitions(Wrapper& wrapper)
 {
     Dictionary result;
-    const auto& definitions = Wrapper::GetInstance()->GetOptionDefinitions();
+    const auto& definitions = wrapper.GetOptionDefinitions();
     for (const auto& [key, value] : definitions)
     {
         Ref<LibretroOptionDefinition> definition = memnew(LibretroOptionDefinition);
@@ -110,10 +350,10 @@ Dictionary Libretro::GetOptionDefinitions()
     return result;
 }
 
-Dictionary Libretro::GetOptionValues()
+Dictionary Libretro::GetOptionValues(Wrapper& wrapper)
 {
     Dictionary result;
-    const auto& values = Wrapper::GetInstance()->GetOptionValues();
+    const auto& values = wrapper.GetOptionValues();
     for (const auto& [key, value] : values)
         result[String(key.c_str())] = String(value.c_str());
     return result;
@@ -124,8 +364,34 @@ void Libretro::_bind_methods()
     ClassDB::bind_static_method("Libretro", D_METHOD("ConnectOptionsReady", "callable", "flags"), &ConnectOptionsReady, DEFVAL(0u));
     ClassDB::bind_static_method("Libretro", D_METHOD("StartContent", "node", "root_directory", "core_name", "game_path"), &StartContent);
     ClassDB::bind_static_method("Libretro", D_METHOD("StopContent"), &StopContent);
+    ClassDB::bind_static_method("Libretro", D_METHOD("LoadContent", "game_path"), &LoadContent);
+    ClassDB::bind_static_method("Libretro", D_METHOD("Reset"), &Reset);
     ClassDB::bind_static_method("Libretro", D_METHOD("SetCoreOption"), &SetCoreOption);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetPacingMode", "mode", "audio_target_fill"), &SetPacingMode, DEFVAL(0.5f));
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetAudioDspFilter", "path"), &SetAudioDspFilter);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetAudioLatency", "latency_sec"), &SetAudioLatency);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetAudioResamplerQuality", "quality"), &SetAudioResamplerQuality);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetFastForward", "ratio"), &SetFastForward);
+    ClassDB::bind_static_method("Libretro", D_METHOD("Pause"), &Pause);
+    ClassDB::bind_static_method("Libretro", D_METHOD("Resume"), &Resume);
+    ClassDB::bind_static_method("Libretro", D_METHOD("StepFrames", "count"), &StepFrames, DEFVAL(1u));
+    ClassDB::bind_static_method("Libretro", D_METHOD("IsPaused"), &IsPaused);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetSlowMotion", "factor"), &SetSlowMotion);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetMaxCatchUpFrames", "count"), &SetMaxCatchUpFrames);
+    ClassDB::bind_static_method("Libretro", D_METHOD("GetFrameStats"), &GetFrameStats);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetThreadPriority", "priority"), &SetThreadPriority);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetThreadAffinity", "affinity_mask"), &SetThreadAffinity);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetJitAllowed", "allowed"), &SetJitAllowed);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetOutOfProcess", "out_of_process"), &SetOutOfProcess);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetPortDevice", "port", "device"), &SetPortDevice);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetRunAhead", "frames", "second_instance"), &SetRunAhead);
+    ClassDB::bind_static_method("Libretro", D_METHOD("SetCommandBudget", "budget_usec"), &SetCommandBudget);
+    ClassDB::bind_static_method("Libretro", D_METHOD("GetCommandStats"), &GetCommandStats);
+    ClassDB::bind_static_method("Libretro", D_METHOD("GetAudioDspCost"), &GetAudioDspCost);
+    ClassDB::bind_static_method("Libretro", D_METHOD("GetAudioStats"), &GetAudioStats);
+    ClassDB::bind_method(D_METHOD("GetAudioMonitor", "key"), &Libretro::GetAudioMonitor);
 
+    ADD_SIGNAL(MethodInfo("content_stopped"));
     ADD_SIGNAL(MethodInfo("options_ready", PropertyInfo(Variant::DICTIONARY, "categories"), PropertyInfo(Variant::DICTIONARY, "definitions"), PropertyInfo(Variant::DICTIONARY, "current_values")));
 }
 }
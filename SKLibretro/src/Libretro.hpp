@@ -7,6 +7,8 @@
 
 namespace SK
 {
+class Wrapper;
+
 class LibretroOptionCategory : public godot::RefCounted
 {
     GDCLASS(LibretroOptionCategory, godot::RefCounted);
@@ -93,6 +95,7 @@ class Libretro : public godot::Node
     GDCLASS(Libretro, godot::Node);
 
     friend class Wrapper;
+    friend class LibretroPlayer;
     
 public:
     ~Libretro() = default;
@@ -100,9 +103,38 @@ public:
     static void ConnectOptionsReady(const godot::Callable& callable, uint32_t flags = 0u);
     static void StartContent(godot::MeshInstance3D* node, godot::String root_directory, godot::String core_name, godot::String game_path);
     static void StopContent();
+    static void LoadContent(godot::String game_path);
+    static void Reset();
 
     static void SetCoreOption(const godot::String& key, const godot::String& value);
-
+    static void SetPacingMode(int32_t mode, float audio_target_fill = 0.5f);
+    static void SetAudioDspFilter(const godot::String& path);
+    static void SetAudioLatency(float latency_sec);
+    static void SetAudioResamplerQuality(int32_t quality);
+    static void SetFastForward(float ratio);
+    static void Pause();
+    static void Resume();
+    static void StepFrames(uint32_t count);
+    static bool IsPaused();
+    static void SetSlowMotion(float factor);
+    static void SetMaxCatchUpFrames(uint32_t count);
+    static void SetThreadPriority(int32_t priority);
+    static void SetThreadAffinity(int64_t affinity_mask);
+    static void SetJitAllowed(bool allowed);
+    // Hosts the core in a sklibretro_host process from the next StartContent on, software rendered cores only
+    static void SetOutOfProcess(bool out_of_process);
+    // Feeds a libretro port from a Godot joypad device, -1 for the RETRO_* actions, -2 to leave it idle
+    static void SetPortDevice(int32_t port, int32_t device);
+    // Frames to run ahead of the shown one to hide the core's input lag, 0 to disable. The second instance keeps the primary from rewinding
+    static void SetRunAhead(int32_t frames, bool second_instance);
+    static godot::Dictionary GetFrameStats();
+    // Time _process may spend running commands from the emulation thread, 0 for no limit
+    static void SetCommandBudget(int64_t budget_usec);
+    static godot::Dictionary GetCommandStats();
+    static godot::Dictionary GetAudioDspCost();
+    static godot::Dictionary GetAudioStats();
+
+    void _enter_tree();
     void _exit_tree();
     void _input(const godot::Ref<godot::InputEvent>& event);
     void _process(double delta);
@@ -112,10 +144,16 @@ private:
 
     static Libretro* m_instance;
 
-    static void NotifyOptionsReady();
-    godot::Dictionary GetOptionCategories();
-    godot::Dictionary GetOptionDefinitions();
-    godot::Dictionary GetOptionValues();
+    // Signals go to the session's owner, this singleton for the default session
+    static void NotifyOptionsReady(Wrapper& wrapper);
+    static void NotifyContentStopped(Wrapper& wrapper);
+    static godot::Dictionary GetOptionCategories(Wrapper& wrapper);
+    static godot::Dictionary GetOptionDefinitions(Wrapper& wrapper);
+    static godot::Dictionary GetOptionValues(Wrapper& wrapper);
+    static godot::Dictionary MakeFrameStats(Wrapper& wrapper);
+    static godot::Dictionary MakeAudioStats(Wrapper& wrapper);
+    // Backs the SKLibretro/Audio/* Performance monitors
+    double GetAudioMonitor(const godot::String& key) const;
 
     static void _bind_methods();
 };
@@ -0,0 +1,154 @@
+#include "LibretroPlayer.hpp"
+
+#include <algorithm>
+
+#include "Libretro.hpp"
+#include "Wrapper.hpp"
+
+using namespace godot;
+
+namespace SK
+{
+LibretroPlayer::LibretroPlayer()
+: m_wrapper(std::make_unique<Wrapper>())
+{
+    m_wrapper->m_owner = this;
+}
+
+LibretroPlayer::~LibretroPlayer()
+{
+    // _exit_tree already stopped it unless the node was never in the tree
+    SessionScope scope(*m_wrapper);
+    m_wrapper->StopContent(true);
+}
+
+void LibretroPlayer::StartContent(MeshInstance3D* node, String root_directory, String core_name, String game_path)
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->StartContent(node, root_directory.utf8().get_data(), core_name.utf8().get_data(), game_path.utf8().get_data());
+}
+
+void LibretroPlayer::StopContent()
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->StopContent();
+}
+
+void LibretroPlayer::LoadContent(String game_path)
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->LoadContent(game_path.utf8().get_data());
+}
+
+void LibretroPlayer::Reset()
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->Reset();
+}
+
+void LibretroPlayer::SetCoreOption(const String& key, const String& value)
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->SetCoreOption(key.utf8().get_data(), value.utf8().get_data());
+}
+
+void LibretroPlayer::SetFastForward(float ratio)
+{
+    m_wrapper->SetFastForward(ratio);
+}
+
+void LibretroPlayer::SetOutOfProcess(bool out_of_process)
+{
+    m_wrapper->SetOutOfProcess(out_of_process);
+}
+
+void LibretroPlayer::SetPortDevice(int32_t port, int32_t device)
+{
+    m_wrapper->SetPortDevice(static_cast<uint32_t>(port), device);
+}
+
+void LibretroPlayer::SetRunAhead(int32_t frames, bool second_instance)
+{
+    m_wrapper->SetRunAhead(static_cast<uint32_t>(std::max(frames, 0)), second_instance);
+}
+
+void LibretroPlayer::Pause()
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->Pause();
+}
+
+void LibretroPlayer::Resume()
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->Resume();
+}
+
+bool LibretroPlayer::IsPaused()
+{
+    return m_wrapper->IsPaused();
+}
+
+void LibretroPlayer::SetInputEnabled(bool enabled)
+{
+    m_wrapper->m_input_enabled = enabled;
+}
+
+bool LibretroPlayer::IsInputEnabled() const
+{
+    return m_wrapper->m_input_enabled;
+}
+
+Dictionary LibretroPlayer::GetFrameStats()
+{
+    return Libretro::MakeFrameStats(*m_wrapper);
+}
+
+Dictionary LibretroPlayer::GetAudioStats()
+{
+    return Libretro::MakeAudioStats(*m_wrapper);
+}
+
+void LibretroPlayer::_exit_tree()
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->StopContent(true);
+}
+
+void LibretroPlayer::_input(const Ref<InputEvent>& event)
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->_input(event);
+}
+
+void LibretroPlayer::_process(double delta)
+{
+    SessionScope scope(*m_wrapper);
+    m_wrapper->_process(delta);
+}
+
+void LibretroPlayer::_bind_methods()
+{
+    ClassDB::bind_method(D_METHOD("StartContent", "node", "root_directory", "core_name", "game_path"), &LibretroPlayer::StartContent);
+    ClassDB::bind_method(D_METHOD("StopContent"), &LibretroPlayer::StopContent);
+    ClassDB::bind_method(D_METHOD("LoadContent", "game_path"), &LibretroPlayer::LoadContent);
+    ClassDB::bind_method(D_METHOD("Reset"), &LibretroPlayer::Reset);
+    ClassDB::bind_method(D_METHOD("SetCoreOption", "key", "value"), &LibretroPlayer::SetCoreOption);
+    ClassDB::bind_method(D_METHOD("SetFastForward", "ratio"), &LibretroPlayer::SetFastForward);
+    ClassDB::bind_method(D_METHOD("SetOutOfProcess", "out_of_process"), &LibretroPlayer::SetOutOfProcess);
+    ClassDB::bind_method(D_METHOD("SetPortDevice", "port", "device"), &LibretroPlayer::SetPortDevice);
+    ClassDB::bind_method(D_METHOD("SetRunAhead", "frames", "second_instance"), &LibretroPlayer::SetRunAhead);
+    ClassDB::bind_method(D_METHOD("Pause"), &LibretroPlayer::Pause);
+    ClassDB::bind_method(D_METHOD("Resume"), &LibretroPlayer::Resume);
+    ClassDB::bind_method(D_METHOD("IsPaused"), &LibretroPlayer::IsPaused);
+    ClassDB::bind_method(D_METHOD("SetInputEnabled", "enabled"), &LibretroPlayer::SetInputEnabled);
+    ClassDB::bind_method(D_METHOD("IsInputEnabled"), &LibretroPlayer::IsInputEnabled);
+    ClassDB::bind_method(D_METHOD("GetFrameStats"), &LibretroPlayer::GetFrameStats);
+    ClassDB::bind_method(D_METHOD("GetAudioStats"), &LibretroPlayer::GetAudioStats);
+
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "input_enabled"), "SetInputEnabled", "IsInputEnabled");
+
+    ADD_SIGNAL(MethodInfo("content_stopped"));
+    ADD_SIGNAL(MethodInfo("options_ready", PropertyInfo(Variant::DICTIONARY, "categories"), PropertyInfo(Variant::DICTIONARY, "definitions"), PropertyInfo(Variant::DICTIONARY, "current_values")));
+}
+}
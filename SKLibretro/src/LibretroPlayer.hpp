@@ -0,0 +1,51 @@
+#pragma once
+
+#include <godot_cpp/classes/node.hpp>
+#include <godot_cpp/classes/mesh_instance3d.hpp>
+#include <godot_cpp/classes/input_event.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+
+#include <memory>
+
+namespace SK
+{
+class Wrapper;
+
+// One independent emulator session per node, with its own core, handlers and emulation thread
+class LibretroPlayer : public godot::Node
+{
+    GDCLASS(LibretroPlayer, godot::Node);
+
+public:
+    LibretroPlayer();
+    ~LibretroPlayer();
+
+    void StartContent(godot::MeshInstance3D* node, godot::String root_directory, godot::String core_name, godot::String game_path);
+    void StopContent();
+    void LoadContent(godot::String game_path);
+    void Reset();
+
+    void SetCoreOption(const godot::String& key, const godot::String& value);
+    void SetFastForward(float ratio);
+    void SetOutOfProcess(bool out_of_process);
+    void SetPortDevice(int32_t port, int32_t device);
+    void SetRunAhead(int32_t frames, bool second_instance);
+    void Pause();
+    void Resume();
+    bool IsPaused();
+    void SetInputEnabled(bool enabled);
+    bool IsInputEnabled() const;
+    godot::Dictionary GetFrameStats();
+    godot::Dictionary GetAudioStats();
+
+    void _exit_tree();
+    void _input(const godot::Ref<godot::InputEvent>& event);
+    void _process(double delta);
+
+private:
+    std::unique_ptr<Wrapper> m_wrapper;
+
+protected:
+    static void _bind_methods();
+};
+}
@@ -22,7 +22,9 @@ bool LogHandler::GetLogInterface(retro_log_callback* callback)
 
 void LogHandler::LogInterfaceLog(retro_log_level level, const char* fmt, ...)
 {
-    if (level < Wrapper::GetInstance()->m_log_handler->m_log_level)
+    // Core worker threads aren't bound to a session and may land on the default one while it is idle
+    auto& log_handler = Wrapper::GetCurrent()->m_log_handler;
+    if (log_handler && level < log_handler->m_log_level)
         return;
 
     va_list args;
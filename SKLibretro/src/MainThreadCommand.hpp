@@ -0,0 +1,13 @@
+#pragma once
+
+#include <variant>
+
+#include "ThreadCommandInitAudio.hpp"
+#include "ThreadCommandCreateTexture.hpp"
+#include "ThreadCommandUpdateTexture.hpp"
+
+namespace SK
+{
+// Everything the emulation thread asks of the main thread, stored by value in the command ring
+using MainThreadCommand = std::variant<std::monostate, ThreadCommandInitAudio, ThreadCommandCreateTexture, ThreadCommandUpdateTexture>;
+}
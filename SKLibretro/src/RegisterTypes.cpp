@@ -1,5 +1,6 @@
 
 #include "Libretro.hpp"
+#include "LibretroPlayer.hpp"
 
 #include <gdextension_interface.h>
 #include <godot_cpp/core/defs.hpp>
@@ -16,6 +17,7 @@ void initialize(ModuleInitializationLevel p_level)
     ClassDB::register_class<SK::LibretroOptionValue>();
     ClassDB::register_class<SK::LibretroOptionDefinition>();
     ClassDB::register_runtime_class<SK::Libretro>();
+    ClassDB::register_runtime_class<SK::LibretroPlayer>();
 }
 
 void uninitialize(ModuleInitializationLevel p_level)
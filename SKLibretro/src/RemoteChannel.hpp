@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <new>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <ctime>
+#include <cerrno>
+#endif
+
+// Shared between the extension and the sklibretro_host process, keep it free of Godot and of the rest of the frontend
+namespace SK::Remote
+{
+constexpr uint32_t s_magic   = 0x534b5243; // SKRC
+constexpr uint32_t s_version = 1;
+
+constexpr uint32_t s_max_ports        = 4;
+constexpr uint32_t s_max_frame_width  = 2048;
+constexpr uint32_t s_max_frame_height = 2048;
+constexpr uint32_t s_max_audio_frames = 16384;
+
+enum class Request : uint32_t
+{
+    None = 0,
+    RunFrame = 1,
+    Reset = 2,
+    Quit = 3
+};
+
+enum class HostState : uint32_t
+{
+    Starting = 0,
+    Ready = 1,
+    Failed = 2
+};
+
+// One block per session. The extension writes a request and bumps request_seq, the host answers by copying it to response_seq,
+// so each side only ever waits on the counter the other one owns
+struct SharedBlock
+{
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> host_state;
+
+    // Filled by the host once the game is loaded
+    double fps;
+    double sample_rate;
+    uint32_t base_width;
+    uint32_t base_height;
+    uint32_t max_width;
+    uint32_t max_height;
+
+    alignas(64) std::atomic<uint32_t> request_seq;
+    Request request;
+    alignas(64) std::atomic<uint32_t> response_seq;
+
+    // Input snapshot for the next retro_run
+    uint16_t joypad[s_max_ports];
+    int16_t analog[s_max_ports][2][2];
+
+    // Output of the last retro_run, the frame is converted to RGBA8 straight into this block
+    uint32_t frame_width;
+    uint32_t frame_height;
+    uint32_t frame_presented;
+    uint32_t audio_frames;
+    uint64_t run_usec;
+
+    alignas(64) uint8_t frame[s_max_frame_width * s_max_frame_height * 4];
+    int16_t audio[s_max_audio_frames * 2];
+};
+
+class Channel
+{
+public:
+    Channel() = default;
+    ~Channel() { Close(); }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Parent side, everything is created inheritable so the child can open it from GetHandlesArgument.
+    // The spawner must restrict inheritance to GetInheritedHandles, or every other session's channel leaks into the child
+    bool Create()
+    {
+#if defined(_WIN32)
+        SECURITY_ATTRIBUTES attributes = { sizeof(attributes), nullptr, TRUE };
+        m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, &attributes, PAGE_READWRITE, 0, sizeof(SharedBlock), nullptr);
+        m_request_event = CreateEventW(&attributes, FALSE, FALSE, nullptr);
+        m_response_event = CreateEventW(&attributes, FALSE, FALSE, nullptr);
+        if (!m_mapping || !m_request_event || !m_response_event)
+            return false;
+
+        m_block = static_cast<SharedBlock*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedBlock)));
+#else
+        m_fd = static_cast<int>(syscall(SYS_memfd_create, "sklibretro", MFD_CLOEXEC));
+        if (m_fd < 0 || ftruncate(m_fd, sizeof(SharedBlock)) != 0)
+            return false;
+
+        void* memory = mmap(nullptr, sizeof(SharedBlock), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        m_block = memory == MAP_FAILED ? nullptr : static_cast<SharedBlock*>(memory);
+#endif
+        if (!m_block)
+            return false;
+
+        // Fresh pages are zeroed, only the atomics need constructing
+        new (&m_block->host_state) std::atomic<uint32_t>(static_cast<uint32_t>(HostState::Starting));
+        new (&m_block->request_seq) std::atomic<uint32_t>(0);
+        new (&m_block->response_seq) std::atomic<uint32_t>(0);
+        m_block->magic = s_magic;
+        m_block->version = s_version;
+        return true;
+    }
+
+    // Child side
+    bool Open(const std::string& handles)
+    {
+#if defined(_WIN32)
+        unsigned long long mapping = 0, request_event = 0, response_event = 0;
+        if (sscanf_s(handles.c_str(), "%llx:%llx:%llx", &mapping, &request_event, &response_event) != 3)
+            return false;
+
+        m_mapping = reinterpret_cast<HANDLE>(mapping);
+        m_request_event = reinterpret_cast<HANDLE>(request_event);
+        m_response_event = reinterpret_cast<HANDLE>(response_event);
+        m_block = static_cast<SharedBlock*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedBlock)));
+#else
+        m_fd = std::stoi(handles);
+        void* memory = mmap(nullptr, sizeof(SharedBlock), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        m_block = memory == MAP_FAILED ? nullptr : static_cast<SharedBlock*>(memory);
+#endif
+        return m_block && m_block->magic == s_magic && m_block->version == s_version;
+    }
+
+    std::string GetHandlesArgument() const
+    {
+#if defined(_WIN32)
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%llx:%llx:%llx", reinterpret_cast<unsigned long long>(m_mapping), reinterpret_cast<unsigned long long>(m_request_event), reinterpret_cast<unsigned long long>(m_response_event));
+        return buffer;
+#else
+        return std::to_string(m_fd);
+#endif
+    }
+
+#if defined(_WIN32)
+    std::array<HANDLE, 3> GetInheritedHandles() const { return { m_mapping, m_request_event, m_response_event }; }
+#else
+    int GetFd() const { return m_fd; }
+#endif
+
+    void Close()
+    {
+#if defined(_WIN32)
+        if (m_block)
+            UnmapViewOfFile(m_block);
+        for (HANDLE* handle : { &m_mapping, &m_request_event, &m_response_event })
+        {
+            if (*handle)
+                CloseHandle(*handle);
+            *handle = nullptr;
+        }
+#else
+        if (m_block)
+            munmap(m_block, sizeof(SharedBlock));
+        if (m_fd >= 0)
+            close(m_fd);
+        m_fd = -1;
+#endif
+        m_block = nullptr;
+    }
+
+    SharedBlock* GetBlock() const { return m_block; }
+
+    // Extension side
+    uint32_t PostRequest(Request request)
+    {
+        m_block->request = request;
+        uint32_t seq = m_block->request_seq.fetch_add(1, std::memory_order_release) + 1;
+        Wake(m_block->request_seq, RequestEvent());
+        return seq;
+    }
+
+    bool WaitResponse(uint32_t seq, std::chrono::microseconds timeout)
+    {
+        return WaitFor(m_block->response_seq, seq, timeout, ResponseEvent());
+    }
+
+    // Host side
+    bool WaitRequest(uint32_t seq, std::chrono::microseconds timeout)
+    {
+        return WaitFor(m_block->request_seq, seq, timeout, RequestEvent());
+    }
+
+    void PostResponse(uint32_t seq)
+    {
+        m_block->response_seq.store(seq, std::memory_order_release);
+        Wake(m_block->response_seq, ResponseEvent());
+    }
+
+private:
+    SharedBlock* m_block = nullptr;
+#if defined(_WIN32)
+    HANDLE m_mapping = nullptr;
+    HANDLE m_request_event = nullptr;
+    HANDLE m_response_event = nullptr;
+    HANDLE RequestEvent() const { return m_request_event; }
+    HANDLE ResponseEvent() const { return m_response_event; }
+#else
+    int m_fd = -1;
+    void* RequestEvent() const { return nullptr; }
+    void* ResponseEvent() const { return nullptr; }
+#endif
+
+    template<typename Event>
+    static void Wake(std::atomic<uint32_t>& word, Event event)
+    {
+#if defined(_WIN32)
+        SetEvent(event);
+#else
+        // Not FUTEX_PRIVATE, the word lives in memory shared with another process
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+    }
+
+    // Waits until word reaches seq, false on timeout
+    template<typename Event>
+    static bool WaitFor(std::atomic<uint32_t>& word, uint32_t seq, std::chrono::microseconds timeout, Event event)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true)
+        {
+            uint32_t value = word.load(std::memory_order_acquire);
+            if (static_cast<int32_t>(value - seq) >= 0)
+                return true;
+
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0)
+                return false;
+#if defined(_WIN32)
+            WaitForSingleObject(event, static_cast<DWORD>((remaining.count() + 999) / 1000));
+#else
+            timespec wait_time = { static_cast<time_t>(remaining.count() / 1000000), static_cast<long>((remaining.count() % 1000000) * 1000) };
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, &wait_time, nullptr, 0);
+#endif
+        }
+    }
+};
+}
@@ -0,0 +1,385 @@
+#include "RemoteCore.hpp"
+
+#include "RemoteChannel.hpp"
+#include "Debug.hpp"
+
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace SK
+{
+static void HostPathAnchor()
+{
+}
+
+#if defined(_WIN32)
+static std::wstring ToWide(const std::string& value)
+{
+    if (value.empty())
+        return std::wstring();
+
+    int length = MultiByteToWideChar(CP_UTF8, 0, value.c_str(), static_cast<int>(value.size()), nullptr, 0);
+    std::wstring result(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, value.c_str(), static_cast<int>(value.size()), result.data(), length);
+    return result;
+}
+#endif
+
+RemoteCore::RemoteCore() = default;
+
+RemoteCore::~RemoteCore()
+{
+    Stop();
+}
+
+std::string RemoteCore::GetHostExecutablePath()
+{
+    // The host ships next to the extension library, wherever Godot loaded that from
+#if defined(_WIN32)
+    HMODULE module = nullptr;
+    GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, reinterpret_cast<LPCWSTR>(&HostPathAnchor), &module);
+    wchar_t module_path[MAX_PATH] = {};
+    GetModuleFileNameW(module, module_path, MAX_PATH);
+    return (std::filesystem::path(module_path).parent_path() / "sklibretro_host.exe").string();
+#else
+    Dl_info info = {};
+    dladdr(reinterpret_cast<void*>(&HostPathAnchor), &info);
+    return (std::filesystem::path(info.dli_fname ? info.dli_fname : "").parent_path() / "sklibretro_host").string();
+#endif
+}
+
+Remote::SharedBlock* RemoteCore::GetBlock() const
+{
+    return m_channel ? m_channel->GetBlock() : nullptr;
+}
+
+void RemoteCore::SetInput(uint32_t port, uint16_t joypad, int16_t left_x, int16_t left_y, int16_t right_x, int16_t right_y)
+{
+    auto block = GetBlock();
+    if (!block || port >= Remote::s_max_ports)
+        return;
+
+    block->joypad[port] = joypad;
+    block->analog[port][RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_X] = left_x;
+    block->analog[port][RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_Y] = left_y;
+    block->analog[port][RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_X] = right_x;
+    block->analog[port][RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_Y] = right_y;
+}
+
+const uint8_t* RemoteCore::GetFrame(uint32_t& width, uint32_t& height) const
+{
+    auto block = GetBlock();
+    if (!block || !block->frame_presented)
+        return nullptr;
+
+    width = block->frame_width;
+    height = block->frame_height;
+    return block->frame;
+}
+
+const int16_t* RemoteCore::GetAudio(size_t& frames) const
+{
+    auto block = GetBlock();
+    frames = block ? block->audio_frames : 0;
+    return block ? block->audio : nullptr;
+}
+
+bool RemoteCore::Start(const LaunchInfo& launch_info)
+{
+    m_launch_info = launch_info;
+    m_restarts = 0;
+    m_restarts_in_window = 0;
+    m_ipc_overhead_usec = 0.0;
+    m_alive = Spawn();
+    return m_alive;
+}
+
+void RemoteCore::Stop()
+{
+    if (m_channel && !HostExited())
+    {
+        // Let the core unload and flush its saves, a host that doesn't answer is killed anyway
+        uint32_t seq = m_channel->PostRequest(Remote::Request::Quit);
+        Await(seq, std::chrono::seconds(2));
+    }
+
+    KillHost();
+    m_channel.reset();
+    m_alive = false;
+}
+
+bool RemoteCore::RunFrame()
+{
+    if (!m_alive)
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t seq = m_channel->PostRequest(Remote::Request::RunFrame);
+    if (!Await(seq, s_frame_timeout))
+    {
+        Restart();
+        return false;
+    }
+
+    double round_trip_usec = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    double overhead_usec = std::max(round_trip_usec - static_cast<double>(GetBlock()->run_usec), 0.0);
+    m_ipc_overhead_usec = m_ipc_overhead_usec > 0.0 ? m_ipc_overhead_usec * 0.95 + overhead_usec * 0.05 : overhead_usec;
+    return true;
+}
+
+void RemoteCore::Reset()
+{
+    if (!m_alive)
+        return;
+
+    uint32_t seq = m_channel->PostRequest(Remote::Request::Reset);
+    if (!Await(seq, s_frame_timeout))
+        Restart();
+}
+
+bool RemoteCore::Spawn()
+{
+    KillHost();
+
+    m_channel = std::make_unique<Remote::Channel>();
+    if (!m_channel->Create())
+    {
+        LogError("Failed to create the shared memory channel for the core host.");
+        return false;
+    }
+
+    std::string host_path = GetHostExecutablePath();
+    if (!std::filesystem::is_regular_file(host_path))
+    {
+        LogError("Core host not found: " + host_path);
+        return false;
+    }
+
+#if defined(_WIN32)
+    std::wstring command_line = L"\"" + ToWide(host_path) + L"\" " + ToWide(m_channel->GetHandlesArgument());
+    for (const auto* argument : { &m_launch_info.core_path, &m_launch_info.game_path, &m_launch_info.system_directory, &m_launch_info.save_directory })
+        command_line += L" \"" + ToWide(*argument) + L"\"";
+
+    // Only this channel's handles are inherited, not every inheritable handle Godot and the other sessions hold
+    auto handles = m_channel->GetInheritedHandles();
+    SIZE_T attribute_list_size = 0;
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &attribute_list_size);
+    std::vector<uint8_t> attribute_list_buffer(attribute_list_size);
+    auto attribute_list = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attribute_list_buffer.data());
+    if (!InitializeProcThreadAttributeList(attribute_list, 1, 0, &attribute_list_size))
+    {
+        LogError("Failed to prepare the core host attributes: " + std::to_string(GetLastError()));
+        return false;
+    }
+    if (!UpdateProcThreadAttribute(attribute_list, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, handles.data(), handles.size() * sizeof(HANDLE), nullptr, nullptr))
+    {
+        LogError("Failed to prepare the core host attributes: " + std::to_string(GetLastError()));
+        DeleteProcThreadAttributeList(attribute_list);
+        return false;
+    }
+
+    STARTUPINFOEXW startup_info = {};
+    startup_info.StartupInfo.cb = sizeof(startup_info);
+    startup_info.lpAttributeList = attribute_list;
+    PROCESS_INFORMATION process_info = {};
+    BOOL created = CreateProcessW(nullptr, command_line.data(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED | EXTENDED_STARTUPINFO_PRESENT,
+                                  nullptr, nullptr, &startup_info.StartupInfo, &process_info);
+    DeleteProcThreadAttributeList(attribute_list);
+    if (!created)
+    {
+        LogError("Failed to start the core host: " + std::to_string(GetLastError()));
+        return false;
+    }
+
+    // The job takes the host down with us, even if Godot itself crashes
+    m_job = CreateJobObjectW(nullptr, nullptr);
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    SetInformationJobObject(m_job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+    AssignProcessToJobObject(m_job, process_info.hProcess);
+
+    ResumeThread(process_info.hThread);
+    CloseHandle(process_info.hThread);
+    m_process = process_info.hProcess;
+#else
+    // Everything the child needs is prepared up front, only async-signal-safe calls are allowed between fork and exec
+    std::vector<std::string> arguments = { host_path, "3", m_launch_info.core_path, m_launch_info.game_path, m_launch_info.system_directory, m_launch_info.save_directory };
+    std::vector<char*> argv;
+    for (auto& argument : arguments)
+        argv.push_back(argument.data());
+    argv.push_back(nullptr);
+
+    int fd = m_channel->GetFd();
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    if (max_fd < 0)
+        max_fd = 1024;
+
+    m_pid = fork();
+    if (m_pid == 0)
+    {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (fd == 3)
+            fcntl(fd, F_SETFD, 0);
+        else
+            dup2(fd, 3);
+
+        // Only stdio and this channel go to the host, not whatever else Godot or the other sessions left without FD_CLOEXEC
+#if defined(SYS_close_range)
+        if (syscall(SYS_close_range, 4u, ~0u, 0u) != 0)
+#endif
+        {
+            for (long i = 4; i < max_fd; i++)
+                close(static_cast<int>(i));
+        }
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    if (m_pid < 0)
+    {
+        LogError("Failed to fork the core host.");
+        m_pid = -1;
+        return false;
+    }
+#endif
+
+    auto block = m_channel->GetBlock();
+    auto deadline = std::chrono::steady_clock::now() + s_start_timeout;
+    while (block->host_state.load(std::memory_order_acquire) == static_cast<uint32_t>(Remote::HostState::Starting))
+    {
+        if (HostExited() || std::chrono::steady_clock::now() >= deadline)
+        {
+            LogError("Core host did not come up: " + m_launch_info.core_path);
+            KillHost();
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (block->host_state.load(std::memory_order_acquire) != static_cast<uint32_t>(Remote::HostState::Ready))
+    {
+        LogError("Core host failed to load: " + m_launch_info.core_path + " " + m_launch_info.game_path);
+        KillHost();
+        return false;
+    }
+
+    m_av_info = {};
+    m_av_info.timing.fps = block->fps;
+    m_av_info.timing.sample_rate = block->sample_rate;
+    m_av_info.geometry.base_width = block->base_width;
+    m_av_info.geometry.base_height = block->base_height;
+    m_av_info.geometry.max_width = block->max_width;
+    m_av_info.geometry.max_height = block->max_height;
+    return true;
+}
+
+bool RemoteCore::HostExited()
+{
+#if defined(_WIN32)
+    if (!m_process)
+        return true;
+    if (WaitForSingleObject(m_process, 0) != WAIT_OBJECT_0)
+        return false;
+
+    DWORD exit_code = 0;
+    GetExitCodeProcess(m_process, &exit_code);
+    if (exit_code != 0)
+        LogError("Core host exited with code " + std::to_string(exit_code));
+    CloseHandle(m_process);
+    m_process = nullptr;
+    return true;
+#else
+    if (m_pid < 0)
+        return true;
+
+    int status = 0;
+    if (waitpid(m_pid, &status, WNOHANG) != m_pid)
+        return false;
+
+    if (WIFSIGNALED(status))
+        LogError("Core host killed by signal " + std::to_string(WTERMSIG(status)));
+    else if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+        LogError("Core host exited with code " + std::to_string(WEXITSTATUS(status)));
+    m_pid = -1;
+    return true;
+#endif
+}
+
+void RemoteCore::KillHost()
+{
+#if defined(_WIN32)
+    if (m_process)
+    {
+        TerminateProcess(m_process, 1);
+        WaitForSingleObject(m_process, INFINITE);
+        CloseHandle(m_process);
+        m_process = nullptr;
+    }
+    if (m_job)
+    {
+        CloseHandle(m_job);
+        m_job = nullptr;
+    }
+#else
+    if (m_pid > 0)
+    {
+        kill(m_pid, SIGKILL);
+        waitpid(m_pid, nullptr, 0);
+        m_pid = -1;
+    }
+#endif
+}
+
+bool RemoteCore::Await(uint32_t seq, std::chrono::microseconds timeout)
+{
+    // Short slices so a dead host is noticed right away instead of after the full timeout
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        if (m_channel->WaitResponse(seq, std::chrono::milliseconds(50)))
+            return true;
+        if (HostExited())
+            return false;
+    }
+
+    LogError("Core host stopped responding.");
+    KillHost();
+    return false;
+}
+
+bool RemoteCore::Restart()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_restart_window_start > std::chrono::minutes(1))
+    {
+        m_restart_window_start = now;
+        m_restarts_in_window = 0;
+    }
+
+    if (++m_restarts_in_window > s_max_restarts_per_minute)
+    {
+        LogError("Core host keeps crashing, giving up.");
+        KillHost();
+        m_alive = false;
+        return false;
+    }
+
+    m_restarts++;
+    LogWarning("Restarting core host, the running game state is lost.");
+    m_alive = Spawn();
+    return m_alive;
+}
+}
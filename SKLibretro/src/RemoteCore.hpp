@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <chrono>
+
+#include <libretro.h>
+
+namespace SK::Remote
+{
+struct SharedBlock;
+class Channel;
+}
+
+namespace SK
+{
+// Runs a core inside a sklibretro_host child process so a crashing core can't take Godot down with it
+// Frames, audio and input go through one shared memory block per session, in lockstep with the emulation thread
+class RemoteCore
+{
+public:
+    struct LaunchInfo
+    {
+        std::string core_path;
+        std::string game_path;
+        std::string system_directory;
+        std::string save_directory;
+    };
+
+    RemoteCore();
+    ~RemoteCore();
+
+    // Spawns the host and blocks until it loaded the game or gave up
+    bool Start(const LaunchInfo& launch_info);
+    void Stop();
+
+    // Runs one retro_run in the host. A crashed or hung host is restarted, the frame is lost and false returned
+    bool RunFrame();
+    void Reset();
+
+    // Input for the next RunFrame, written straight into the shared block
+    void SetInput(uint32_t port, uint16_t joypad, int16_t left_x, int16_t left_y, int16_t right_x, int16_t right_y);
+    // Output of the last RunFrame, valid until the next request. GetFrame is null when the core duped
+    const uint8_t* GetFrame(uint32_t& width, uint32_t& height) const;
+    const int16_t* GetAudio(size_t& frames) const;
+
+    Remote::SharedBlock* GetBlock() const;
+    const retro_system_av_info& GetAvInfo() const { return m_av_info; }
+    const LaunchInfo& GetLaunchInfo() const { return m_launch_info; }
+    // False once the host kept crashing and the supervisor gave up
+    bool IsAlive() const { return m_alive; }
+    uint32_t GetRestarts() const { return m_restarts; }
+    // Round trip minus the time the host spent in retro_run, averaged
+    double GetIpcOverheadUsec() const { return m_ipc_overhead_usec; }
+
+    static std::string GetHostExecutablePath();
+
+private:
+    static constexpr auto s_start_timeout = std::chrono::seconds(10);
+    static constexpr auto s_frame_timeout = std::chrono::seconds(5);
+    static constexpr uint32_t s_max_restarts_per_minute = 3;
+
+    LaunchInfo m_launch_info;
+    std::unique_ptr<Remote::Channel> m_channel;
+    retro_system_av_info m_av_info = {};
+    bool m_alive = false;
+    uint32_t m_restarts = 0;
+    std::chrono::steady_clock::time_point m_restart_window_start = {};
+    uint32_t m_restarts_in_window = 0;
+    double m_ipc_overhead_usec = 0.0;
+
+#if defined(_WIN32)
+    void* m_process = nullptr;
+    void* m_job = nullptr;
+#else
+    int m_pid = -1;
+#endif
+
+    bool Spawn();
+    bool HostExited();
+    void KillHost();
+    // Waits for a response while watching the process, false when it died or timed out
+    bool Await(uint32_t seq, std::chrono::microseconds timeout);
+    bool Restart();
+};
+}
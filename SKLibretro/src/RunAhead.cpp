@@ -0,0 +1,236 @@
+#include "RunAhead.hpp"
+
+#include "Wrapper.hpp"
+#include "Debug.hpp"
+
+#include <chrono>
+
+namespace SK
+{
+static void Average(std::atomic<double>& average, double value)
+{
+    double current = average.load(std::memory_order_relaxed);
+    average.store(current > 0.0 ? current * 0.95 + value * 0.05 : value, std::memory_order_relaxed);
+}
+
+static double ElapsedUsec(FrameScheduler::Clock::time_point from, FrameScheduler::Clock::time_point to)
+{
+    return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+void StatePool::Reserve(size_t size, size_t count)
+{
+    m_buffers.clear();
+    for (size_t i = 0; i < count; i++)
+        m_buffers.emplace_back(std::make_unique<uint8_t[]>(size));
+    m_buffer_size = size;
+    m_next = 0;
+}
+
+uint8_t* StatePool::Acquire(size_t size)
+{
+    if (size > m_buffer_size || m_buffers.empty())
+        return nullptr;
+
+    uint8_t* buffer = m_buffers[m_next].get();
+    m_next = (m_next + 1) % m_buffers.size();
+    return buffer;
+}
+
+void StatePool::Clear()
+{
+    m_buffers.clear();
+    m_buffer_size = 0;
+    m_next = 0;
+}
+
+void RunAhead::RunFrame(Wrapper& wrapper, uint32_t frames, bool second_instance, bool present)
+{
+    SessionContext& session = wrapper.m_session;
+    Core& core = *wrapper.m_core;
+
+    if (!second_instance && m_second_instance)
+        ReleaseSecondInstance(wrapper);
+
+    // The audio callback thread calls into the core whenever it likes, it can't be kept out of a serialize or a rewind
+    if (wrapper.m_audio_handler->IsAudioCallbackRunning())
+    {
+        if (!m_audio_callback_refused)
+        {
+            LogWarning("Run-ahead is not available while the core renders audio from its audio callback, running frames as usual.");
+            m_audio_callback_refused = true;
+        }
+        core.retro_run();
+        return;
+    }
+
+    // A core may report no state size before its first frames, those run as usual
+    size_t size = m_unsupported ? 0 : core.retro_serialize_size();
+    if (size == 0)
+    {
+        core.retro_run();
+        return;
+    }
+
+    // Some cores grow their state once the game is running, the headroom keeps that to a single reallocation
+    if (m_pool.GetBufferSize() < size)
+    {
+        m_pool.Reserve(size + size / 4, s_pool_buffers);
+        Log("Run-ahead state buffers sized to " + std::to_string(m_pool.GetBufferSize()) + " bytes");
+    }
+
+    bool use_second_instance = second_instance && !m_second_instance_failed && (m_second_instance || LoadSecondInstance(wrapper));
+
+    // The real frame is heard but never shown, the last speculative frame replaces it on screen
+    session.present_frame = false;
+    core.retro_run();
+
+    auto start = FrameScheduler::Clock::now();
+    uint8_t* state = m_pool.Acquire(size);
+    session.savestate_context = use_second_instance ? RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_BINARY : RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE;
+    bool saved = core.retro_serialize(state, size);
+    auto serialized = FrameScheduler::Clock::now();
+
+    if (!saved)
+    {
+        LogWarning("Run-ahead disabled, the core failed to save its state.");
+        m_unsupported = true;
+    }
+    else if (use_second_instance)
+    {
+        // The primary never rewinds, so neither its audio nor its timeline are touched by the speculation
+        session.secondary_core = true;
+        bool loaded = m_second_instance->retro_unserialize(state, size);
+        auto unserialized = FrameScheduler::Clock::now();
+        if (loaded)
+            RunSpeculativeFrames(wrapper, *m_second_instance, frames, present);
+        session.secondary_core = false;
+
+        if (loaded)
+        {
+            Average(m_unserialize_usec, ElapsedUsec(serialized, unserialized));
+        }
+        else
+        {
+            LogWarning("Run-ahead second instance rejected the state, falling back to a single instance.");
+            ReleaseSecondInstance(wrapper);
+            m_second_instance_failed = true;
+        }
+    }
+    else
+    {
+        RunSpeculativeFrames(wrapper, core, frames, present);
+
+        auto unserialize_start = FrameScheduler::Clock::now();
+        if (!core.retro_unserialize(state, size))
+        {
+            // The core is now ahead of where it should be, nothing to do about that but stop speculating
+            LogError("Run-ahead disabled, the core failed to restore its state.");
+            m_unsupported = true;
+        }
+        Average(m_unserialize_usec, ElapsedUsec(unserialize_start, FrameScheduler::Clock::now()));
+    }
+
+    session.savestate_context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+    session.present_frame = present;
+
+    auto end = FrameScheduler::Clock::now();
+    Average(m_serialize_usec, ElapsedUsec(start, serialized));
+    Average(m_run_ahead_usec, ElapsedUsec(start, end));
+    m_state_size.store(size, std::memory_order_relaxed);
+}
+
+void RunAhead::RunSpeculativeFrames(Wrapper& wrapper, Core& core, uint32_t frames, bool present)
+{
+    SessionContext& session = wrapper.m_session;
+
+    // Staged single samples belong to whichever side of the drop they were made on
+    bool drop_audio = session.drop_audio;
+    wrapper.m_audio_handler->FlushStagedSamples();
+    session.speculative = true;
+    session.drop_audio = true;
+    wrapper.m_audio_handler->SetDropAudio(true);
+
+    for (uint32_t frame = 1; frame <= frames; frame++)
+    {
+        session.present_frame = present && frame == frames;
+        core.retro_run();
+    }
+
+    wrapper.m_audio_handler->FlushStagedSamples();
+    session.speculative = false;
+    session.drop_audio = drop_audio;
+    wrapper.m_audio_handler->SetDropAudio(drop_audio);
+}
+
+bool RunAhead::LoadSecondInstance(Wrapper& wrapper)
+{
+    // A hardware rendered core would need a GL context of its own
+    if (wrapper.m_video_handler->IsHwRender())
+    {
+        LogWarning("Run-ahead second instance is not available for hardware rendered cores, using a single instance.");
+        m_second_instance_failed = true;
+        return false;
+    }
+
+    SessionContext& session = wrapper.m_session;
+
+    // Load copies the library to its own temp file, so this instance gets its own globals
+    auto core = std::make_unique<Core>(wrapper.m_core_path);
+    session.secondary_core = true;
+    bool loaded = core->Load();
+    if (loaded && !wrapper.LoadGameInto(*core))
+    {
+        core->retro_deinit();
+        loaded = false;
+    }
+    if (!loaded)
+        core->Unload();
+    session.secondary_core = false;
+
+    if (!loaded)
+    {
+        LogWarning("Failed to load the run-ahead second instance, using a single instance.");
+        m_second_instance_failed = true;
+        return false;
+    }
+
+    Log("Run-ahead second instance loaded.");
+    m_second_instance = std::move(core);
+    m_using_second_instance = true;
+    return true;
+}
+
+void RunAhead::ReleaseSecondInstance(Wrapper& wrapper)
+{
+    if (!m_second_instance)
+        return;
+
+    SessionContext& session = wrapper.m_session;
+    session.secondary_core = true;
+    m_second_instance->retro_unload_game();
+    m_second_instance->retro_deinit();
+    m_second_instance->Unload();
+    session.secondary_core = false;
+
+    m_second_instance = nullptr;
+    m_using_second_instance = false;
+}
+
+void RunAhead::Reset()
+{
+    m_unsupported = false;
+    m_second_instance_failed = false;
+    m_audio_callback_refused = false;
+    m_run_ahead_usec = 0.0;
+    m_serialize_usec = 0.0;
+    m_unserialize_usec = 0.0;
+    m_state_size = 0;
+}
+
+void RunAhead::Shutdown(Wrapper& wrapper)
+{
+    ReleaseSecondInstance(wrapper);
+    m_pool.Clear();
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace SK
+{
+class Wrapper;
+class Core;
+
+// Fixed set of state buffers, sized once for the core and only regrown if its serialize size does
+class StatePool
+{
+public:
+    void Reserve(size_t size, size_t count);
+    // Round robin over the reserved buffers, null if size doesn't fit. Never allocates
+    uint8_t* Acquire(size_t size);
+    void Clear();
+
+    size_t GetBufferSize() const { return m_buffer_size; }
+
+private:
+    std::vector<std::unique_ptr<uint8_t[]>> m_buffers;
+    size_t m_buffer_size = 0;
+    size_t m_next = 0;
+};
+
+// Hides the core's own input lag: every real frame is followed by speculative ones whose last frame is shown,
+// then the core goes back to the state right after the real frame. Emulation thread only, apart from the stats
+class RunAhead
+{
+public:
+    // Runs the real frame and the speculative ones, the real frame is the only one that is heard
+    void RunFrame(Wrapper& wrapper, uint32_t frames, bool second_instance, bool present);
+    // Unloads the second instance, it is loaded again from the current content when next needed
+    void ReleaseSecondInstance(Wrapper& wrapper);
+    // Session start, clears the stats and anything a previous core gave up on
+    void Reset();
+    // Session end, before the primary core is unloaded
+    void Shutdown(Wrapper& wrapper);
+
+    // Averaged cost of everything on top of the real frame, and the parts of it
+    double GetRunAheadUsec() const { return m_run_ahead_usec.load(std::memory_order_relaxed); }
+    double GetSerializeUsec() const { return m_serialize_usec.load(std::memory_order_relaxed); }
+    double GetUnserializeUsec() const { return m_unserialize_usec.load(std::memory_order_relaxed); }
+    uint64_t GetStateSize() const { return m_state_size.load(std::memory_order_relaxed); }
+    bool IsUsingSecondInstance() const { return m_using_second_instance.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t s_pool_buffers = 2;
+
+    StatePool m_pool;
+    std::unique_ptr<Core> m_second_instance;
+    // Set once something failed for this session, no point retrying every frame
+    bool m_unsupported = false;
+    bool m_second_instance_failed = false;
+    // Only there so the refusal is logged once per session
+    bool m_audio_callback_refused = false;
+
+    std::atomic<double> m_run_ahead_usec = 0.0;
+    std::atomic<double> m_serialize_usec = 0.0;
+    std::atomic<double> m_unserialize_usec = 0.0;
+    std::atomic<uint64_t> m_state_size = 0;
+    std::atomic<bool> m_using_second_instance = false;
+
+    bool LoadSecondInstance(Wrapper& wrapper);
+    void RunSpeculativeFrames(Wrapper& wrapper, Core& core, uint32_t frames, bool present);
+};
+}
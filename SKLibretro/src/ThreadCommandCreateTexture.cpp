@@ -19,6 +19,6 @@ ThreadCommandCreateTexture::ThreadCommandCreateTexture(Image::Format image_forma
 
 void ThreadCommandCreateTexture::Execute()
 {
-    Wrapper::GetInstance()->m_video_handler->CreateTexture(m_width, m_height, m_imageFormat, m_pixelData, m_flipY);
+    Wrapper::GetCurrent()->m_video_handler->CreateTexture(m_width, m_height, m_imageFormat, m_pixelData, m_flipY);
 }
 }
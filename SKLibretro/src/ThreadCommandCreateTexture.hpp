@@ -1,18 +1,15 @@
 #pragma once
 
-#include "ThreadCommand.hpp"
-
 #include <godot_cpp/classes/image.hpp>
 
 namespace SK
 {
-class ThreadCommandCreateTexture : public ThreadCommand
+class ThreadCommandCreateTexture
 {
 public:
     ThreadCommandCreateTexture(godot::Image::Format image_format, godot::PackedByteArray pixel_data, int32_t width, int32_t height, bool flip_y);
-    ~ThreadCommandCreateTexture() override = default;
 
-    void Execute() override;
+    void Execute();
 
 private:
     godot::Image::Format m_imageFormat;
@@ -8,19 +8,19 @@
 
 namespace SK
 {
-ThreadCommandInitAudio::ThreadCommandInitAudio(float bufferCapacitySec, double sampleRate)
-: m_bufferCapacitySec(bufferCapacitySec)
+ThreadCommandInitAudio::ThreadCommandInitAudio(float latencySec, double sampleRate)
+: m_latencySec(latencySec)
 , m_sampleRate(sampleRate)
 {
 }
 
 void ThreadCommandInitAudio::Execute()
 {
-    auto instance = Wrapper::GetInstance();
+    auto instance = Wrapper::GetCurrent();
 
     std::unique_lock<std::mutex> lock(instance->m_mutex);
 
-    instance->m_audio_handler->Init(m_bufferCapacitySec, m_sampleRate);
+    instance->m_audio_handler->Init(m_latencySec, m_sampleRate);
 
     instance->m_mutex_done = true;
     instance->m_condition_variable.notify_one();
@@ -1,19 +1,16 @@
 #pragma once
 
-#include "ThreadCommand.hpp"
-
 namespace SK
 {
-class ThreadCommandInitAudio : public ThreadCommand
+class ThreadCommandInitAudio
 {
 public:
-    ThreadCommandInitAudio(float bufferCapacitySec, double sampleRate);
-    ~ThreadCommandInitAudio() override = default;
+    ThreadCommandInitAudio(float latencySec, double sampleRate);
 
-    void Execute() override;
+    void Execute();
 
 private:
-    float m_bufferCapacitySec;
+    float m_latencySec;
     double m_sampleRate;
 };
 }
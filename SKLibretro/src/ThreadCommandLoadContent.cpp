@@ -0,0 +1,16 @@
+#include "ThreadCommandLoadContent.hpp"
+
+#include "Wrapper.hpp"
+
+namespace SK
+{
+ThreadCommandLoadContent::ThreadCommandLoadContent(const std::string& gamePath)
+: m_gamePath(gamePath)
+{
+}
+
+void ThreadCommandLoadContent::Execute()
+{
+    Wrapper::GetCurrent()->SwapContent(m_gamePath);
+}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ThreadCommand.hpp"
+
+#include <string>
+
+namespace SK
+{
+// Runs on the emulation thread, swaps the loaded game while keeping the core and every handler alive
+class ThreadCommandLoadContent : public ThreadCommand
+{
+public:
+    ThreadCommandLoadContent(const std::string& gamePath);
+    ~ThreadCommandLoadContent() override = default;
+
+    void Execute() override;
+
+private:
+    std::string m_gamePath;
+};
+}
@@ -0,0 +1,15 @@
+#include "ThreadCommandReset.hpp"
+
+#include "Wrapper.hpp"
+
+namespace SK
+{
+void ThreadCommandReset::Execute()
+{
+    auto instance = Wrapper::GetCurrent();
+    if (instance->m_remote_core)
+        instance->m_remote_core->Reset();
+    else
+        instance->m_core->retro_reset();
+}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ThreadCommand.hpp"
+
+namespace SK
+{
+// Runs on the emulation thread between two retro_run calls
+class ThreadCommandReset : public ThreadCommand
+{
+public:
+    ThreadCommandReset() = default;
+    ~ThreadCommandReset() override = default;
+
+    void Execute() override;
+};
+}
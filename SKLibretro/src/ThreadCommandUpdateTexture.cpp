@@ -14,6 +14,6 @@ ThreadCommandUpdateTexture::ThreadCommandUpdateTexture(PackedByteArray pixelData
 
 void ThreadCommandUpdateTexture::Execute()
 {
-    Wrapper::GetInstance()->m_video_handler->UpdateTexture(m_pixelData, m_flipY);
+    Wrapper::GetCurrent()->m_video_handler->UpdateTexture(m_pixelData, m_flipY);
 }
 }
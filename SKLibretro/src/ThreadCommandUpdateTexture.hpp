@@ -1,18 +1,15 @@
 #pragma once
 
-#include "ThreadCommand.hpp"
-
 #include <godot_cpp/variant/packed_byte_array.hpp>
 
 namespace SK
 {
-class ThreadCommandUpdateTexture : public ThreadCommand
+class ThreadCommandUpdateTexture
 {
 public:
     ThreadCommandUpdateTexture(godot::PackedByteArray pixelData, bool flipY);
-    ~ThreadCommandUpdateTexture() override = default;
 
-    void Execute() override;
+    void Execute();
 
 private:
     godot::PackedByteArray m_pixelData;
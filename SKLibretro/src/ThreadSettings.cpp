@@ -0,0 +1,128 @@
+#include "ThreadSettings.hpp"
+
+#include "Debug.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#if defined(__APPLE__)
+#include <TargetConditionals.h>
+#endif
+
+namespace SK
+{
+#if defined(_WIN32)
+static void SetPriority(ThreadPriority priority)
+{
+    int value = THREAD_PRIORITY_NORMAL;
+    switch (priority)
+    {
+    case ThreadPriority::Low:          value = THREAD_PRIORITY_LOWEST;        break;
+    case ThreadPriority::Normal:       value = THREAD_PRIORITY_NORMAL;        break;
+    case ThreadPriority::High:         value = THREAD_PRIORITY_HIGHEST;       break;
+    case ThreadPriority::TimeCritical: value = THREAD_PRIORITY_TIME_CRITICAL; break;
+    }
+
+    if (!SetThreadPriority(GetCurrentThread(), value))
+        LogWarning("Failed to set emulation thread priority: " + std::to_string(GetLastError()));
+}
+
+static void SetAffinity(uint64_t affinity_mask)
+{
+    if (!SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(affinity_mask)))
+        LogWarning("Failed to set emulation thread affinity: " + std::to_string(GetLastError()));
+}
+
+static void SetName(const std::string& name)
+{
+    std::wstring wide_name(name.begin(), name.end());
+    SetThreadDescription(GetCurrentThread(), wide_name.c_str());
+}
+#elif defined(__linux__)
+static bool SetNice(int nice)
+{
+    // On Linux the nice value is per thread when addressed by tid
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice) == 0)
+        return true;
+
+    LogWarning("Failed to set emulation thread nice value " + std::to_string(nice) + ": " + std::strerror(errno));
+    return false;
+}
+
+static void SetPriority(ThreadPriority priority)
+{
+    switch (priority)
+    {
+    case ThreadPriority::Low:    SetNice(10);  break;
+    case ThreadPriority::Normal: SetNice(0);   break;
+    case ThreadPriority::High:   SetNice(-10); break;
+    case ThreadPriority::TimeCritical:
+    {
+        sched_param param = {};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+            return;
+
+        LogWarning("SCHED_FIFO not permitted for the emulation thread, falling back to nice");
+        SetNice(-10);
+    }
+    break;
+    }
+}
+
+static void SetAffinity(uint64_t affinity_mask)
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu = 0; cpu < 64; cpu++)
+        if (affinity_mask & (1ull << cpu))
+            CPU_SET(cpu, &cpu_set);
+
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result != 0)
+        LogWarning("Failed to set emulation thread affinity: " + std::string(std::strerror(result)));
+}
+
+static void SetName(const std::string& name)
+{
+    // Linux thread names are limited to 15 characters plus the terminator
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+}
+#else
+static void SetPriority(ThreadPriority priority) {}
+static void SetAffinity(uint64_t affinity_mask) {}
+static void SetName(const std::string& name) {}
+#endif
+
+void ThreadSettings::ApplyToCurrentThread() const
+{
+    if (!name.empty())
+        SetName(name);
+
+    if (priority != ThreadPriority::Normal)
+        SetPriority(priority);
+
+    if (affinity_mask != 0)
+        SetAffinity(affinity_mask);
+}
+
+bool ThreadSettings::IsJitCapable()
+{
+#if defined(__EMSCRIPTEN__) || (defined(__APPLE__) && (TARGET_OS_IPHONE || TARGET_OS_TV))
+    return false;
+#else
+    return true;
+#endif
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace SK
+{
+enum class ThreadPriority : uint32_t
+{
+    Low = 0,         // nice 10 / THREAD_PRIORITY_LOWEST
+    Normal = 1,      // scheduler default
+    High = 2,        // nice -10 / THREAD_PRIORITY_HIGHEST, needs CAP_SYS_NICE on Linux
+    TimeCritical = 3 // SCHED_FIFO where permitted, otherwise the highest nice we are allowed
+};
+
+struct ThreadSettings
+{
+    ThreadPriority priority = ThreadPriority::Normal;
+    // One bit per logical CPU, 0 leaves the affinity alone
+    uint64_t affinity_mask = 0;
+    std::string name = "SKLibretro";
+    bool allow_jit = true;
+
+    // Applied from the emulation thread itself before retro_init so threads spawned by the core inherit it
+    void ApplyToCurrentThread() const;
+
+    static bool IsJitCapable();
+};
+}
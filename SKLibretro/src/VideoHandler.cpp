@@ -21,27 +21,31 @@ void VideoHandler::RefreshCallback(const void* data, uint32_t width, uint32_t he
     if (!data || width == 0 || height == 0)
         return;
 
-    auto instance = Wrapper::GetInstance();
-    if (!instance)
+    auto session = Wrapper::GetSession();
+    if (!session->video)
     {
-        LogError("RefreshCallback: Null Instance.");
+        LogError("RefreshCallback: No session.");
         return;
     }
 
-    PackedByteArray pixel_data;
+    if (!session->present_frame)
+        return;
+
+    auto instance = session->wrapper;
+    auto video_handler = session->video;
+
+    // Every path below converts to RGBA8
+    PackedByteArray& pixel_data = video_handler->AcquireFrameBuffer(width * height * 4);
 
     if (data == RETRO_HW_FRAME_BUFFER_VALID)
     {
-        int bytes_per_pixel = 4;
-
-        pixel_data.resize(width * height * bytes_per_pixel);
         glReadPixels(0, 0, (int)width, (int)height, GL_RGBA, GL_UNSIGNED_BYTE, pixel_data.ptrw());
-        SDL_GL_SwapWindow(instance->m_video_handler->m_sdl_window);
+        SDL_GL_SwapWindow(video_handler->m_sdl_window);
 
-        if (instance->m_video_handler->m_image.is_null() || instance->m_video_handler->m_image_format != Image::FORMAT_RGBA8 || width != instance->m_video_handler->m_last_width || height != instance->m_video_handler->m_last_height)
+        if (video_handler->m_image.is_null() || video_handler->m_image_format != Image::FORMAT_RGBA8 || width != video_handler->m_last_width || height != video_handler->m_last_height)
         {
-            instance->m_video_handler->m_last_width  = width;
-            instance->m_video_handler->m_last_height = height;
+            video_handler->m_last_width  = width;
+            video_handler->m_last_height = height;
             instance->CreateTexture(Image::FORMAT_RGBA8, pixel_data, (int32_t)width, (int32_t)height, true);
         }
         else
@@ -50,21 +54,19 @@ void VideoHandler::RefreshCallback(const void* data, uint32_t width, uint32_t he
         return;
     }
 
-    switch (instance->m_video_handler->m_pixel_format)
+    switch (video_handler->m_pixel_format)
     {
     case RETRO_PIXEL_FORMAT_XRGB8888:
     {
-        pixel_data.resize(width * height * 4);
-
         const uint8_t* src = static_cast<const uint8_t*>(data);
         uint8_t* dst = pixel_data.ptrw();
 
         conv_argb8888_abgr8888(dst, src, width, height, width * 4, pitch);
 
-        if (instance->m_video_handler->m_image.is_null() || instance->m_video_handler->m_image_format != Image::FORMAT_RGBA8 || width != instance->m_video_handler->m_last_width || height != instance->m_video_handler->m_last_height)
+        if (video_handler->m_image.is_null() || video_handler->m_image_format != Image::FORMAT_RGBA8 || width != video_handler->m_last_width || height != video_handler->m_last_height)
         {
-            instance->m_video_handler->m_last_width  = width;
-            instance->m_video_handler->m_last_height = height;
+            video_handler->m_last_width  = width;
+            video_handler->m_last_height = height;
             instance->CreateTexture(Image::FORMAT_RGBA8, pixel_data, (int32_t)width, (int32_t)height, false);
         }
         else
@@ -73,17 +75,15 @@ void VideoHandler::RefreshCallback(const void* data, uint32_t width, uint32_t he
     break;
     case RETRO_PIXEL_FORMAT_RGB565:
     {
-        pixel_data.resize(width * height * 4);
-
         const uint16_t* src = static_cast<const uint16_t*>(data);
         uint8_t* dst = pixel_data.ptrw();
 
         conv_rgb565_abgr8888(dst, src, width, height, width * 4, pitch);
 
-        if (instance->m_video_handler->m_image.is_null() || instance->m_video_handler->m_image_format != Image::FORMAT_RGBA8 || width != instance->m_video_handler->m_last_width || height != instance->m_video_handler->m_last_height)
+        if (video_handler->m_image.is_null() || video_handler->m_image_format != Image::FORMAT_RGBA8 || width != video_handler->m_last_width || height != video_handler->m_last_height)
         {
-            instance->m_video_handler->m_last_width  = width;
-            instance->m_video_handler->m_last_height = height;
+            video_handler->m_last_width  = width;
+            video_handler->m_last_height = height;
             instance->CreateTexture(Image::FORMAT_RGBA8, pixel_data, (int32_t)width, (int32_t)height, false);
         }
         else
@@ -92,17 +92,15 @@ void VideoHandler::RefreshCallback(const void* data, uint32_t width, uint32_t he
     break;
     case RETRO_PIXEL_FORMAT_0RGB1555:
     {
-        pixel_data.resize(width * height * 4);
-
         const uint16_t* src = static_cast<const uint16_t*>(data);
         uint8_t* dst = pixel_data.ptrw();
 
         conv_0rgb1555_argb8888(dst, src, width, height, width * 4, pitch);
 
-        if (instance->m_video_handler->m_image.is_null() || instance->m_video_handler->m_image_format != Image::FORMAT_RGBA8 || width != instance->m_video_handler->m_last_width || height != instance->m_video_handler->m_last_height)
+        if (video_handler->m_image.is_null() || video_handler->m_image_format != Image::FORMAT_RGBA8 || width != video_handler->m_last_width || height != video_handler->m_last_height)
         {
-            instance->m_video_handler->m_last_width  = width;
-            instance->m_video_handler->m_last_height = height;
+            video_handler->m_last_width  = width;
+            video_handler->m_last_height = height;
             instance->CreateTexture(Image::FORMAT_RGBA8, pixel_data, (int32_t)width, (int32_t)height, false);
         }
         else
@@ -111,7 +109,7 @@ void VideoHandler::RefreshCallback(const void* data, uint32_t width, uint32_t he
     break;
     case RETRO_PIXEL_FORMAT_UNKNOWN:
     default:
-        LogError("Unhandled pixel format: " + std::to_string(instance->m_video_handler->m_pixel_format));
+        LogError("Unhandled pixel format: " + std::to_string(video_handler->m_pixel_format));
         return;
     }
 }
@@ -142,7 +140,7 @@ void VideoHandler::Init(MeshInstance3D* mesh)
 
 void VideoHandler::DeInit()
 {
-    Wrapper::GetInstance()->m_node->set_surface_override_material(0, m_original_surface_material_override);
+    Wrapper::GetCurrent()->m_node->set_surface_override_material(0, m_original_surface_material_override);
 
     if (m_new_material.is_valid())
         m_new_material.unref();
@@ -283,6 +281,25 @@ bool VideoHandler::SetGeometry(const retro_game_geometry* geometry)
     return true;
 }
 
+void VideoHandler::ApplyGeometry(const retro_game_geometry& geometry)
+{
+    if (!m_sdl_window)
+        return;
+
+    // The hardware frame is read back from the hidden window's framebuffer, it has to fit the largest frame the core may render
+    int32_t window_width = 0;
+    int32_t window_height = 0;
+    SDL_GetWindowSize(m_sdl_window, &window_width, &window_height);
+
+    int32_t width = std::max<int32_t>(window_width, geometry.max_width);
+    int32_t height = std::max<int32_t>(window_height, geometry.max_height);
+    if (width != window_width || height != window_height)
+    {
+        Log("Resizing hardware render window to " + std::to_string(width) + "x" + std::to_string(height));
+        SDL_SetWindowSize(m_sdl_window, width, height);
+    }
+}
+
 bool VideoHandler::SetHwRender(retro_hw_render_callback* hw_render_callback)
 {
     if (!hw_render_callback)
@@ -318,6 +335,37 @@ bool VideoHandler::GetPreferredHwRender(retro_hw_context_type* hw_context_type)
     return true;
 }
 
+void VideoHandler::PresentRgba8(const uint8_t* data, uint32_t width, uint32_t height)
+{
+    if (!data || width == 0 || height == 0)
+        return;
+
+    auto instance = Wrapper::GetCurrent();
+
+    PackedByteArray& pixel_data = AcquireFrameBuffer(width * height * 4);
+    memcpy(pixel_data.ptrw(), data, static_cast<size_t>(width) * height * 4);
+
+    if (m_image.is_null() || m_image_format != Image::FORMAT_RGBA8 || width != m_last_width || height != m_last_height)
+    {
+        m_last_width  = width;
+        m_last_height = height;
+        instance->CreateTexture(Image::FORMAT_RGBA8, pixel_data, (int32_t)width, (int32_t)height, false);
+    }
+    else
+        instance->UpdateTexture(pixel_data, false);
+}
+
+PackedByteArray& VideoHandler::AcquireFrameBuffer(int64_t size)
+{
+    m_frame_buffer_index = (m_frame_buffer_index + 1) % m_frame_buffers.size();
+
+    // Same size as last time is a no-op, ptrw only copies if the main thread still holds this buffer
+    PackedByteArray& buffer = m_frame_buffers[m_frame_buffer_index];
+    if (buffer.size() != size)
+        buffer.resize(size);
+    return buffer;
+}
+
 void VideoHandler::CreateTexture(int32_t width, int32_t height, Image::Format image_format, PackedByteArray pixel_data, bool flip_y)
 {
     m_image.instantiate();
@@ -328,7 +376,7 @@ void VideoHandler::CreateTexture(int32_t width, int32_t height, Image::Format im
 
     m_texture = ImageTexture::create_from_image(m_image);
 
-    Wrapper::GetInstance()->m_node->set_surface_override_material(0, m_new_material);
+    Wrapper::GetCurrent()->m_node->set_surface_override_material(0, m_new_material);
     m_new_material->set_texture(StandardMaterial3D::TEXTURE_EMISSION, m_texture);
 }
 
@@ -5,6 +5,7 @@
 #include <godot_cpp/classes/standard_material3d.hpp>
 
 #include <cstdint>
+#include <array>
 
 #include <SDL3/SDL_video.h>
 
@@ -26,13 +27,20 @@ public:
     void SetImageFormat(godot::Image::Format format);
     void CreateTexture(int32_t width, int32_t height, godot::Image::Format image_format, godot::PackedByteArray pixel_data, bool flip_y);
     void UpdateTexture(godot::PackedByteArray pixel_data, bool flip_y);
+    // Emulation thread, rotates through a few buffers so a frame is never converted into one the main thread is still uploading
+    godot::PackedByteArray& AcquireFrameBuffer(int64_t size);
+    // Frames an out of process core already converted to RGBA8, one copy into the upload buffer
+    void PresentRgba8(const uint8_t* data, uint32_t width, uint32_t height);
 
     bool SetRotation(uint32_t rotation);
     bool GetOverscan(int32_t* overscan);
     bool GetCanDupe(bool* can_dupe);
     bool SetPixelFormat(const retro_pixel_format* pixel_format);
     bool SetGeometry(const retro_game_geometry* geometry);
+    // Applied at a frame boundary after SET_SYSTEM_AV_INFO, software textures follow the frame size on their own
+    void ApplyGeometry(const retro_game_geometry& geometry);
     bool SetHwRender(retro_hw_render_callback* hw_render_callback);
+    bool IsHwRender() const { return m_context_reset != nullptr; }
     bool GetPreferredHwRender(retro_hw_context_type* hw_context_type) const;
 
 private:
@@ -43,6 +51,8 @@ private:
     godot::Image::Format m_image_format;
     godot::Ref<godot::Image> m_image = nullptr;
     godot::Ref<godot::ImageTexture> m_texture = nullptr;
+    std::array<godot::PackedByteArray, 3> m_frame_buffers;
+    uint32_t m_frame_buffer_index = 0;
     SDL_Window* m_sdl_window = nullptr;
     SDL_GLContext m_sdl_gl_context = nullptr;
 
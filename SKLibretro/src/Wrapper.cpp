@@ -9,273 +9,245 @@
 #include <godot_cpp/classes/input_event_mouse_button.hpp>
 #include <godot_cpp/classes/input_event_key.hpp>
 #include <godot_cpp/classes/mesh_instance3d.hpp>
+#include <godot_cpp/classes/display_server.hpp>
 
 #include <filesystem>
 #include <fstream>
 #include <chrono>
+#include <array>
 
 #include "Libretro.hpp"
 #include "Debug.hpp"
 #include "ThreadCommandInitAudio.hpp"
 #include "ThreadCommandCreateTexture.hpp"
 #include "ThreadCommandUpdateTexture.hpp"
+#include "ThreadCommandLoadContent.hpp"
+#include "ThreadCommandReset.hpp"
 
 using namespace godot;
 
 namespace SK
 {
+thread_local SessionContext* Wrapper::s_current_session = nullptr;
+
+Wrapper::Wrapper()
+{
+    m_session.wrapper = this;
+}
+
+SessionScope::SessionScope(Wrapper& wrapper)
+: m_previous(Wrapper::s_current_session)
+{
+    Wrapper::s_current_session = &wrapper.m_session;
+}
+
+SessionScope::~SessionScope()
+{
+    Wrapper::s_current_session = m_previous;
+}
+
 Wrapper* Wrapper::GetInstance()
 {
+    // Initialization of a function local static is already thread safe, every later call is a plain load
     static Wrapper instance;
-    static std::mutex instance_mutex;
-    std::lock_guard<std::mutex> lock(instance_mutex);
     return &instance;
 }
 
+struct KeyMapping
+{
+    Key godot;
+    retro_key retro;
+};
+
+// Keys without a libretro counterpart are simply absent and come out as RETROK_UNKNOWN
+static constexpr KeyMapping s_key_mappings[] =
+{
+    { KEY_BACKSPACE, RETROK_BACKSPACE },
+    { KEY_TAB, RETROK_TAB },
+    { KEY_CLEAR, RETROK_CLEAR },
+    { KEY_ENTER, RETROK_RETURN },
+    { KEY_PAUSE, RETROK_PAUSE },
+    { KEY_ESCAPE, RETROK_ESCAPE },
+    { KEY_SPACE, RETROK_SPACE },
+    { KEY_EXCLAM, RETROK_EXCLAIM },
+    { KEY_QUOTEDBL, RETROK_QUOTEDBL },
+    { KEY_NUMBERSIGN, RETROK_HASH },
+    { KEY_DOLLAR, RETROK_DOLLAR },
+    { KEY_AMPERSAND, RETROK_AMPERSAND },
+    { KEY_APOSTROPHE, RETROK_QUOTE },
+    { KEY_PARENLEFT, RETROK_LEFTPAREN },
+    { KEY_PARENRIGHT, RETROK_RIGHTPAREN },
+    { KEY_ASTERISK, RETROK_ASTERISK },
+    { KEY_PLUS, RETROK_PLUS },
+    { KEY_COMMA, RETROK_COMMA },
+    { KEY_MINUS, RETROK_MINUS },
+    { KEY_PERIOD, RETROK_PERIOD },
+    { KEY_SLASH, RETROK_SLASH },
+    { KEY_0, RETROK_0 },
+    { KEY_1, RETROK_1 },
+    { KEY_2, RETROK_2 },
+    { KEY_3, RETROK_3 },
+    { KEY_4, RETROK_4 },
+    { KEY_5, RETROK_5 },
+    { KEY_6, RETROK_6 },
+    { KEY_7, RETROK_7 },
+    { KEY_8, RETROK_8 },
+    { KEY_9, RETROK_9 },
+    { KEY_COLON, RETROK_COLON },
+    { KEY_SEMICOLON, RETROK_SEMICOLON },
+    { KEY_LESS, RETROK_LESS },
+    { KEY_EQUAL, RETROK_EQUALS },
+    { KEY_GREATER, RETROK_GREATER },
+    { KEY_QUESTION, RETROK_QUESTION },
+    { KEY_AT, RETROK_AT },
+    { KEY_BRACKETLEFT, RETROK_LEFTBRACKET },
+    { KEY_BACKSLASH, RETROK_BACKSLASH },
+    { KEY_BRACKETRIGHT, RETROK_RIGHTBRACKET },
+    { KEY_ASCIICIRCUM, RETROK_CARET },
+    { KEY_UNDERSCORE, RETROK_UNDERSCORE },
+    { KEY_QUOTELEFT, RETROK_BACKQUOTE },
+    { KEY_A, RETROK_a },
+    { KEY_B, RETROK_b },
+    { KEY_C, RETROK_c },
+    { KEY_D, RETROK_d },
+    { KEY_E, RETROK_e },
+    { KEY_F, RETROK_f },
+    { KEY_G, RETROK_g },
+    { KEY_H, RETROK_h },
+    { KEY_I, RETROK_i },
+    { KEY_J, RETROK_j },
+    { KEY_K, RETROK_k },
+    { KEY_L, RETROK_l },
+    { KEY_M, RETROK_m },
+    { KEY_N, RETROK_n },
+    { KEY_O, RETROK_o },
+    { KEY_P, RETROK_p },
+    { KEY_Q, RETROK_q },
+    { KEY_R, RETROK_r },
+    { KEY_S, RETROK_s },
+    { KEY_T, RETROK_t },
+    { KEY_U, RETROK_u },
+    { KEY_V, RETROK_v },
+    { KEY_W, RETROK_w },
+    { KEY_X, RETROK_x },
+    { KEY_Y, RETROK_y },
+    { KEY_Z, RETROK_z },
+    { KEY_BRACELEFT, RETROK_LEFTBRACE },
+    { KEY_BAR, RETROK_BAR },
+    { KEY_BRACERIGHT, RETROK_RIGHTBRACE },
+    { KEY_ASCIITILDE, RETROK_TILDE },
+    { KEY_DELETE, RETROK_DELETE },
+    { KEY_KP_0, RETROK_KP0 },
+    { KEY_KP_1, RETROK_KP1 },
+    { KEY_KP_2, RETROK_KP2 },
+    { KEY_KP_3, RETROK_KP3 },
+    { KEY_KP_4, RETROK_KP4 },
+    { KEY_KP_5, RETROK_KP5 },
+    { KEY_KP_6, RETROK_KP6 },
+    { KEY_KP_7, RETROK_KP7 },
+    { KEY_KP_8, RETROK_KP8 },
+    { KEY_KP_9, RETROK_KP9 },
+    { KEY_KP_PERIOD, RETROK_KP_PERIOD },
+    { KEY_KP_DIVIDE, RETROK_KP_DIVIDE },
+    { KEY_KP_MULTIPLY, RETROK_KP_MULTIPLY },
+    { KEY_KP_SUBTRACT, RETROK_KP_MINUS },
+    { KEY_KP_ADD, RETROK_KP_PLUS },
+    { KEY_KP_ENTER, RETROK_KP_ENTER },
+    // { KEY_KP_EQUALS, RETROK_KP_EQUALS },
+    { KEY_UP, RETROK_UP },
+    { KEY_DOWN, RETROK_DOWN },
+    { KEY_RIGHT, RETROK_RIGHT },
+    { KEY_LEFT, RETROK_LEFT },
+    { KEY_INSERT, RETROK_INSERT },
+    { KEY_HOME, RETROK_HOME },
+    { KEY_END, RETROK_END },
+    { KEY_PAGEUP, RETROK_PAGEUP },
+    { KEY_PAGEDOWN, RETROK_PAGEDOWN },
+    { KEY_F1, RETROK_F1 },
+    { KEY_F2, RETROK_F2 },
+    { KEY_F3, RETROK_F3 },
+    { KEY_F4, RETROK_F4 },
+    { KEY_F5, RETROK_F5 },
+    { KEY_F6, RETROK_F6 },
+    { KEY_F7, RETROK_F7 },
+    { KEY_F8, RETROK_F8 },
+    { KEY_F9, RETROK_F9 },
+    { KEY_F10, RETROK_F10 },
+    { KEY_F11, RETROK_F11 },
+    { KEY_F12, RETROK_F12 },
+    { KEY_F13, RETROK_F13 },
+    { KEY_F14, RETROK_F14 },
+    { KEY_F15, RETROK_F15 },
+    { KEY_NUMLOCK, RETROK_NUMLOCK },
+    { KEY_CAPSLOCK, RETROK_CAPSLOCK },
+    { KEY_SCROLLLOCK, RETROK_SCROLLOCK },
+    // { KEY_MODE, RETROK_MODE },
+    // { KEY_COMPOSE, RETROK_COMPOSE },
+    { KEY_HELP, RETROK_HELP },
+    { KEY_PRINT, RETROK_PRINT },
+    { KEY_SYSREQ, RETROK_SYSREQ },
+    // { KEY_BREAK, RETROK_BREAK },
+    { KEY_MENU, RETROK_MENU },
+    // { KEY_POWER, RETROK_POWER },
+    // { KEY_EURO, RETROK_EURO },
+    // { KEY_UNDO, RETROK_UNDO },
+    // { KEY_OEM_102, RETROK_OEM_102 },
+    { KEY_BACK, RETROK_BROWSER_BACK },
+    { KEY_FORWARD, RETROK_BROWSER_FORWARD },
+    { KEY_REFRESH, RETROK_BROWSER_REFRESH },
+    { KEY_STOP, RETROK_BROWSER_STOP },
+    { KEY_SEARCH, RETROK_BROWSER_SEARCH },
+    { KEY_FAVORITES, RETROK_BROWSER_FAVORITES },
+    { KEY_HOMEPAGE, RETROK_BROWSER_HOME },
+    { KEY_VOLUMEMUTE, RETROK_VOLUME_MUTE },
+    { KEY_VOLUMEDOWN, RETROK_VOLUME_DOWN },
+    { KEY_VOLUMEUP, RETROK_VOLUME_UP },
+    { KEY_MEDIANEXT, RETROK_MEDIA_NEXT },
+    { KEY_MEDIAPREVIOUS, RETROK_MEDIA_PREV },
+    { KEY_MEDIASTOP, RETROK_MEDIA_STOP },
+    { KEY_MEDIAPLAY, RETROK_MEDIA_PLAY_PAUSE },
+    { KEY_LAUNCHMAIL, RETROK_LAUNCH_MAIL },
+    { KEY_LAUNCHMEDIA, RETROK_LAUNCH_MEDIA },
+    // { KEY_LAUNCH_APP1, RETROK_LAUNCH_APP1 },
+    // { KEY_LAUNCH_APP2, RETROK_LAUNCH_APP2 },
+};
+
+// Godot keycodes are either a unicode value below 256 or KEY_SPECIAL plus a small index, both halves fit one flat table
+static constexpr size_t s_key_table_size = 512;
+
+static constexpr size_t KeyTableIndex(int64_t keycode)
+{
+    if (keycode & KEY_SPECIAL)
+        keycode = (keycode & ~static_cast<int64_t>(KEY_SPECIAL)) + 256;
+    return keycode >= 0 && keycode < static_cast<int64_t>(s_key_table_size) ? static_cast<size_t>(keycode) : s_key_table_size;
+}
+
+static constexpr std::array<uint16_t, s_key_table_size> s_key_table = []
+{
+    std::array<uint16_t, s_key_table_size> table = {};
+    for (const KeyMapping& mapping : s_key_mappings)
+        table[KeyTableIndex(mapping.godot)] = static_cast<uint16_t>(mapping.retro);
+    return table;
+}();
+
 static retro_key GodotToLibretroKeycode(const Ref<InputEventKey>& keyEvent)
 {
-    switch (keyEvent->get_keycode())
-    {
-        case KEY_NONE: return RETROK_UNKNOWN;
-        case KEY_BACKSPACE: return RETROK_BACKSPACE;
-        case KEY_TAB: return RETROK_TAB;
-        case KEY_CLEAR: return RETROK_CLEAR;
-        case KEY_ENTER: return RETROK_RETURN;
-        case KEY_PAUSE: return RETROK_PAUSE;
-        case KEY_ESCAPE: return RETROK_ESCAPE;
-        case KEY_SPACE: return RETROK_SPACE;
-        case KEY_EXCLAM: return RETROK_EXCLAIM;
-        case KEY_QUOTEDBL: return RETROK_QUOTEDBL;
-        case KEY_NUMBERSIGN: return RETROK_HASH;
-        case KEY_DOLLAR: return RETROK_DOLLAR;
-        case KEY_AMPERSAND: return RETROK_AMPERSAND;
-        case KEY_APOSTROPHE: return RETROK_QUOTE;
-        case KEY_PARENLEFT: return RETROK_LEFTPAREN;
-        case KEY_PARENRIGHT: return RETROK_RIGHTPAREN;
-        case KEY_ASTERISK: return RETROK_ASTERISK;
-        case KEY_PLUS: return RETROK_PLUS;
-        case KEY_COMMA: return RETROK_COMMA;
-        case KEY_MINUS: return RETROK_MINUS;
-        case KEY_PERIOD: return RETROK_PERIOD;
-        case KEY_SLASH: return RETROK_SLASH;
-        case KEY_0: return RETROK_0;
-        case KEY_1: return RETROK_1;
-        case KEY_2: return RETROK_2;
-        case KEY_3: return RETROK_3;
-        case KEY_4: return RETROK_4;
-        case KEY_5: return RETROK_5;
-        case KEY_6: return RETROK_6;
-        case KEY_7: return RETROK_7;
-        case KEY_8: return RETROK_8;
-        case KEY_9: return RETROK_9;
-        case KEY_COLON: return RETROK_COLON;
-        case KEY_SEMICOLON: return RETROK_SEMICOLON;
-        case KEY_LESS: return RETROK_LESS;
-        case KEY_EQUAL: return RETROK_EQUALS;
-        case KEY_GREATER: return RETROK_GREATER;
-        case KEY_QUESTION: return RETROK_QUESTION;
-        case KEY_AT: return RETROK_AT;
-        case KEY_BRACKETLEFT: return RETROK_LEFTBRACKET;
-        case KEY_BACKSLASH: return RETROK_BACKSLASH;
-        case KEY_BRACKETRIGHT: return RETROK_RIGHTBRACKET;
-        case KEY_ASCIICIRCUM: return RETROK_CARET;
-        case KEY_UNDERSCORE: return RETROK_UNDERSCORE;
-        case KEY_QUOTELEFT: return RETROK_BACKQUOTE;
-        case KEY_A: return RETROK_a;
-        case KEY_B: return RETROK_b;
-        case KEY_C: return RETROK_c;
-        case KEY_D: return RETROK_d;
-        case KEY_E: return RETROK_e;
-        case KEY_F: return RETROK_f;
-        case KEY_G: return RETROK_g;
-        case KEY_H: return RETROK_h;
-        case KEY_I: return RETROK_i;
-        case KEY_J: return RETROK_j;
-        case KEY_K: return RETROK_k;
-        case KEY_L: return RETROK_l;
-        case KEY_M: return RETROK_m;
-        case KEY_N: return RETROK_n;
-        case KEY_O: return RETROK_o;
-        case KEY_P: return RETROK_p;
-        case KEY_Q: return RETROK_q;
-        case KEY_R: return RETROK_r;
-        case KEY_S: return RETROK_s;
-        case KEY_T: return RETROK_t;
-        case KEY_U: return RETROK_u;
-        case KEY_V: return RETROK_v;
-        case KEY_W: return RETROK_w;
-        case KEY_X: return RETROK_x;
-        case KEY_Y: return RETROK_y;
-        case KEY_Z: return RETROK_z;
-        case KEY_BRACELEFT: return RETROK_LEFTBRACE;
-        case KEY_BAR: return RETROK_BAR;
-        case KEY_BRACERIGHT: return RETROK_RIGHTBRACE;
-        case KEY_ASCIITILDE: return RETROK_TILDE;
-        case KEY_DELETE: return RETROK_DELETE;
-        case KEY_KP_0: return RETROK_KP0;
-        case KEY_KP_1: return RETROK_KP1;
-        case KEY_KP_2: return RETROK_KP2;
-        case KEY_KP_3: return RETROK_KP3;
-        case KEY_KP_4: return RETROK_KP4;
-        case KEY_KP_5: return RETROK_KP5;
-        case KEY_KP_6: return RETROK_KP6;
-        case KEY_KP_7: return RETROK_KP7;
-        case KEY_KP_8: return RETROK_KP8;
-        case KEY_KP_9: return RETROK_KP9;
-        case KEY_KP_PERIOD: return RETROK_KP_PERIOD;
-        case KEY_KP_DIVIDE: return RETROK_KP_DIVIDE;
-        case KEY_KP_MULTIPLY: return RETROK_KP_MULTIPLY;
-        case KEY_KP_SUBTRACT: return RETROK_KP_MINUS;
-        case KEY_KP_ADD: return RETROK_KP_PLUS;
-        case KEY_KP_ENTER: return RETROK_KP_ENTER;
-        // case KEY_KP_EQUALS: return RETROK_KP_EQUALS;
-        case KEY_UP: return RETROK_UP;
-        case KEY_DOWN: return RETROK_DOWN;
-        case KEY_RIGHT: return RETROK_RIGHT;
-        case KEY_LEFT: return RETROK_LEFT;
-        case KEY_INSERT: return RETROK_INSERT;
-        case KEY_HOME: return RETROK_HOME;
-        case KEY_END: return RETROK_END;
-        case KEY_PAGEUP: return RETROK_PAGEUP;
-        case KEY_PAGEDOWN: return RETROK_PAGEDOWN;
-        case KEY_F1: return RETROK_F1;
-        case KEY_F2: return RETROK_F2;
-        case KEY_F3: return RETROK_F3;
-        case KEY_F4: return RETROK_F4;
-        case KEY_F5: return RETROK_F5;
-        case KEY_F6: return RETROK_F6;
-        case KEY_F7: return RETROK_F7;
-        case KEY_F8: return RETROK_F8;
-        case KEY_F9: return RETROK_F9;
-        case KEY_F10: return RETROK_F10;
-        case KEY_F11: return RETROK_F11;
-        case KEY_F12: return RETROK_F12;
-        case KEY_F13: return RETROK_F13;
-        case KEY_F14: return RETROK_F14;
-        case KEY_F15: return RETROK_F15;
-        case KEY_NUMLOCK: return RETROK_NUMLOCK;
-        case KEY_CAPSLOCK: return RETROK_CAPSLOCK;
-        case KEY_SCROLLLOCK: return RETROK_SCROLLOCK;
-        case KEY_SHIFT:
-        {
-            if (keyEvent->get_location() == KeyLocation::KEY_LOCATION_LEFT)
-                return RETROK_LSHIFT;
-            if (keyEvent->get_location() == KeyLocation::KEY_LOCATION_RIGHT)
-                return RETROK_RSHIFT;
-        }
-        break;
-        case KEY_CTRL:
-        {
-            if (keyEvent->get_location() == KeyLocation::KEY_LOCATION_LEFT)
-                return RETROK_LCTRL;
-            if (keyEvent->get_location() == KeyLocation::KEY_LOCATION_RIGHT)
-                return RETROK_RCTRL;
-        }
-        break;
-        case KEY_ALT:
-        {
-            if (keyEvent->get_location() == KeyLocation::KEY_LOCATION_LEFT)
-                return RETROK_LALT;
-            if (keyEvent->get_location() == KeyLocation::KEY_LOCATION_RIGHT)
-                return RETROK_RALT;
-        }
-        break;
-        case KEY_META:
-        {
-            // NOTE: may need to return RETROK_LSUPER/RETK_RSUPER instead for some platforms
-            if (keyEvent->get_location() == KeyLocation::KEY_LOCATION_LEFT)
-                return RETROK_LMETA;
-            if (keyEvent->get_location() == KeyLocation::KEY_LOCATION_RIGHT)
-                return RETROK_RMETA;
-        }
-        break;
-        // case KEY_MODE: return RETROK_MODE;
-        // case KEY_COMPOSE: return RETROK_COMPOSE;
-        case KEY_HELP: return RETROK_HELP;
-        case KEY_PRINT: return RETROK_PRINT;
-        case KEY_SYSREQ: return RETROK_SYSREQ;
-        // case KEY_BREAK: return RETROK_BREAK;
-        case KEY_MENU: return RETROK_MENU;
-        // case KEY_POWER: return RETROK_POWER;
-        // case KEY_EURO: return RETROK_EURO;
-        // case KEY_UNDO: return RETROK_UNDO;
-        // case KEY_OEM_102: return RETROK_OEM_102;
-        case KEY_BACK: return RETROK_BROWSER_BACK;
-        case KEY_FORWARD: return RETROK_BROWSER_FORWARD;
-        case KEY_REFRESH: return RETROK_BROWSER_REFRESH;
-        case KEY_STOP: return RETROK_BROWSER_STOP;
-        case KEY_SEARCH: return RETROK_BROWSER_SEARCH;
-        case KEY_FAVORITES: return RETROK_BROWSER_FAVORITES;
-        case KEY_HOMEPAGE: return RETROK_BROWSER_HOME;
-        case KEY_VOLUMEMUTE: return RETROK_VOLUME_MUTE;
-        case KEY_VOLUMEDOWN: return RETROK_VOLUME_DOWN;
-        case KEY_VOLUMEUP: return RETROK_VOLUME_UP;
-        case KEY_MEDIANEXT: return RETROK_MEDIA_NEXT;
-        case KEY_MEDIAPREVIOUS: return RETROK_MEDIA_PREV;
-        case KEY_MEDIASTOP: return RETROK_MEDIA_STOP;
-        case KEY_MEDIAPLAY: return RETROK_MEDIA_PLAY_PAUSE;
-        case KEY_LAUNCHMAIL: return RETROK_LAUNCH_MAIL;
-        case KEY_LAUNCHMEDIA: return RETROK_LAUNCH_MEDIA;
-        // case KEY_LAUNCH_APP1: return RETROK_LAUNCH_APP1;
-        // case KEY_LAUNCH_APP2: return RETROK_LAUNCH_APP2;
-
-        // Unhandled godot keys
-        case KEY_SPECIAL: return RETROK_UNKNOWN;
-        case KEY_BACKTAB: return RETROK_UNKNOWN;
-        case KEY_F16: return RETROK_UNKNOWN;
-        case KEY_F17: return RETROK_UNKNOWN;
-        case KEY_F18: return RETROK_UNKNOWN;
-        case KEY_F19: return RETROK_UNKNOWN;
-        case KEY_F20: return RETROK_UNKNOWN;
-        case KEY_F21: return RETROK_UNKNOWN;
-        case KEY_F22: return RETROK_UNKNOWN;
-        case KEY_F23: return RETROK_UNKNOWN;
-        case KEY_F24: return RETROK_UNKNOWN;
-        case KEY_F25: return RETROK_UNKNOWN;
-        case KEY_F26: return RETROK_UNKNOWN;
-        case KEY_F27: return RETROK_UNKNOWN;
-        case KEY_F28: return RETROK_UNKNOWN;
-        case KEY_F29: return RETROK_UNKNOWN;
-        case KEY_F30: return RETROK_UNKNOWN;
-        case KEY_F31: return RETROK_UNKNOWN;
-        case KEY_F32: return RETROK_UNKNOWN;
-        case KEY_F33: return RETROK_UNKNOWN;
-        case KEY_F34: return RETROK_UNKNOWN;
-        case KEY_F35: return RETROK_UNKNOWN;
-        case KEY_HYPER: return RETROK_UNKNOWN;
-        case KEY_MEDIARECORD: return RETROK_UNKNOWN;
-        case KEY_STANDBY: return RETROK_UNKNOWN;
-        case KEY_OPENURL: return RETROK_UNKNOWN;
-        case KEY_LAUNCH0: return RETROK_UNKNOWN;
-        case KEY_LAUNCH1: return RETROK_UNKNOWN;
-        case KEY_LAUNCH2: return RETROK_UNKNOWN;
-        case KEY_LAUNCH3: return RETROK_UNKNOWN;
-        case KEY_LAUNCH4: return RETROK_UNKNOWN;
-        case KEY_LAUNCH5: return RETROK_UNKNOWN;
-        case KEY_LAUNCH6: return RETROK_UNKNOWN;
-        case KEY_LAUNCH7: return RETROK_UNKNOWN;
-        case KEY_LAUNCH8: return RETROK_UNKNOWN;
-        case KEY_LAUNCH9: return RETROK_UNKNOWN;
-        case KEY_LAUNCHA: return RETROK_UNKNOWN;
-        case KEY_LAUNCHB: return RETROK_UNKNOWN;
-        case KEY_LAUNCHC: return RETROK_UNKNOWN;
-        case KEY_LAUNCHD: return RETROK_UNKNOWN;
-        case KEY_LAUNCHE: return RETROK_UNKNOWN;
-        case KEY_LAUNCHF: return RETROK_UNKNOWN;
-        case KEY_GLOBE: return RETROK_UNKNOWN;
-        case KEY_KEYBOARD: return RETROK_UNKNOWN;
-        case KEY_JIS_EISU: return RETROK_UNKNOWN;
-        case KEY_JIS_KANA: return RETROK_UNKNOWN;
-        case KEY_UNKNOWN: return RETROK_UNKNOWN;
-        case KEY_PERCENT: return RETROK_UNKNOWN;
-        case KEY_YEN: return RETROK_UNKNOWN;
-        case KEY_SECTION: return RETROK_UNKNOWN;
-        default:
-            LogError("Unmapped key code from Godot to Libretro: " + std::to_string(keyEvent->get_keycode()));
-            break;
-    };
+    Key keycode = keyEvent->get_keycode();
+    KeyLocation location = keyEvent->get_location();
+
+    // Modifiers are the only keys where the location picks the libretro code
+    switch (keycode)
+    {
+    case KEY_SHIFT: return location == KeyLocation::KEY_LOCATION_RIGHT ? RETROK_RSHIFT : RETROK_LSHIFT;
+    case KEY_CTRL:  return location == KeyLocation::KEY_LOCATION_RIGHT ? RETROK_RCTRL : RETROK_LCTRL;
+    case KEY_ALT:   return location == KeyLocation::KEY_LOCATION_RIGHT ? RETROK_RALT : RETROK_LALT;
+    // NOTE: may need to return RETROK_LSUPER/RETK_RSUPER instead for some platforms
+    case KEY_META:  return location == KeyLocation::KEY_LOCATION_RIGHT ? RETROK_RMETA : RETROK_LMETA;
+    default:        break;
+    }
 
-    return RETROK_UNKNOWN;
+    size_t index = KeyTableIndex(keycode);
+    return index < s_key_table_size ? static_cast<retro_key>(s_key_table[index]) : RETROK_UNKNOWN;
 }
 
 static int16_t ToShort(float floatValue, int mul = 1)
@@ -291,22 +263,44 @@ void Wrapper::StartContent(MeshInstance3D* node, const std::string& root_directo
     StopEmulationThread();
 
     m_node = node;
+    m_paused = false;
+    m_was_paused = false;
+    m_step_frames = 0;
+    m_skipped_frames = 0;
+    m_dropped_frames = 0;
+    m_frames_run = 0;
+    m_run_usec = 0.0;
+    m_ipc_overhead_usec = 0.0;
+    m_host_restarts = 0;
+    m_display_locked_rate = 0.0;
 
     auto audio_stream_player = memnew(AudioStreamPlayer);
     audio_stream_player->set_name("AudioStreamPlayer");
     m_node->add_child(audio_stream_player);
 
+#if defined(_WIN32)
     std::filesystem::path core_path = std::filesystem::path(root_directory).append("cores").append(core_name + "_libretro").replace_extension(".dll");
+#else
+    std::filesystem::path core_path = std::filesystem::path(root_directory).append("cores").append(core_name + "_libretro").replace_extension(".so");
+#endif
 
     m_core = std::make_unique<Core>(core_path.string());
     m_environment_handler = std::make_unique<EnvironmentHandler>();
     m_video_handler = std::make_unique<VideoHandler>();
     m_audio_handler = std::make_unique<AudioHandler>();
     m_input_handler = std::make_unique<InputHandler>();
+    m_input_mapper = std::make_unique<InputMapper>();
     m_options_handler = std::make_unique<OptionsHandler>();
     m_message_handler = std::make_unique<MessageHandler>();
     m_log_handler = std::make_unique<LogHandler>();
 
+    m_session = {};
+    m_session.wrapper = this;
+    m_session.video = m_video_handler.get();
+    m_session.audio = m_audio_handler.get();
+    m_session.input = m_input_handler.get();
+    m_session.environment = m_environment_handler.get();
+
     m_video_handler->Init(node);
 
     m_root_directory = root_directory;
@@ -316,6 +310,8 @@ void Wrapper::StartContent(MeshInstance3D* node, const std::string& root_directo
     std::string save_directory = std::filesystem::path(root_directory).append("save").append(core_name).string();
     std::string core_assets_directory = std::filesystem::path(root_directory).append("core_assets").append(core_name).string();
     m_environment_handler->SetDirectories(system_directory, save_directory, core_assets_directory);
+    m_core_path = core_path.string();
+    m_remote_launch_info = { m_core_path, game_path, system_directory, save_directory };
 
     if (!std::filesystem::is_directory(m_temp_directory))
     {
@@ -328,12 +324,35 @@ void Wrapper::StartContent(MeshInstance3D* node, const std::string& root_directo
         }
     }
 
+    m_session_thread_settings = m_thread_settings;
+    m_session_out_of_process = m_out_of_process;
+    m_content_start_time = FrameScheduler::Clock::now();
     m_thread = std::thread(&Wrapper::EmulationThreadLoop, this);
 }
 
-void Wrapper::StopContent()
+void Wrapper::StopContent(bool wait)
 {
-    StopEmulationThread();
+    if (wait)
+        StopEmulationThread();
+    else
+        RequestStop();
+}
+
+void Wrapper::LoadContent(const std::string& game_path)
+{
+    if (!m_core)
+    {
+        LogError("LoadContent needs a running session, use StartContent first.");
+        return;
+    }
+
+    EnqueueEmulationCommand(std::make_unique<ThreadCommandLoadContent>(game_path));
+}
+
+void Wrapper::Reset()
+{
+    if (m_core)
+        EnqueueEmulationCommand(std::make_unique<ThreadCommandReset>());
 }
 
 void Wrapper::SetCoreOption(const std::string& key, const std::string& value)
@@ -342,16 +361,146 @@ void Wrapper::SetCoreOption(const std::string& key, const std::string& value)
         m_options_handler->SetVariable(key, value);
 }
 
+void Wrapper::SetPacingMode(PacingMode mode, float audio_target_fill)
+{
+    PacingMode previous_mode = m_pacing_mode.exchange(mode);
+    m_audio_target_fill = Math::clamp(audio_target_fill, 0.05f, 0.95f);
+
+    // Display pacing needs the resampler even when the rates match, to absorb the speed difference
+    if (m_running && m_audio_handler && (previous_mode == PacingMode::Display) != (mode == PacingMode::Display))
+        m_audio_handler->RequestResize();
+}
+
+void Wrapper::SetAudioDspFilter(const std::string& path)
+{
+    m_audio_dsp_filter_path = path;
+
+    if (m_running && m_audio_handler)
+        m_audio_handler->LoadDspFilter(m_audio_dsp_filter_path);
+}
+
+void Wrapper::SetAudioLatency(float latency_sec)
+{
+    m_audio_latency_sec = Math::clamp(latency_sec, 0.01f, 1.0f);
+
+    if (m_running && m_audio_handler)
+        m_audio_handler->RequestResize();
+}
+
+void Wrapper::SetAudioResamplerQuality(int32_t quality)
+{
+    m_audio_resampler_quality = Math::clamp(quality, 0, 5);
+
+    if (m_running && m_audio_handler)
+        m_audio_handler->RequestResize();
+}
+
+void Wrapper::SetFastForward(float ratio)
+{
+    m_fast_forward_ratio = std::max(ratio, 0.0f);
+}
+
+float Wrapper::GetSpeedRatio() const
+{
+    float ratio = m_fast_forward_ratio;
+
+    // A core driving fast-forward itself wins over the user setting, a negative ratio leaves the factor to us
+    if (m_environment_handler)
+    {
+        const auto& core_override = m_environment_handler->GetFastForwardingOverride();
+        if (core_override.fastforward)
+            return core_override.ratio >= 0.0f ? core_override.ratio : (ratio != 1.0f ? ratio : 0.0f);
+        if (core_override.inhibit_toggle)
+            return 1.0f;
+    }
+
+    return ratio;
+}
+
+void Wrapper::Pause()
+{
+    std::lock_guard<std::mutex> lock(m_pause_mutex);
+    m_paused = true;
+}
+
+void Wrapper::Resume()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pause_mutex);
+        m_paused = false;
+        m_step_frames = 0;
+    }
+    m_pause_condition.notify_all();
+}
+
+void Wrapper::StepFrames(uint32_t count)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pause_mutex);
+        m_paused = true;
+        m_step_frames += count;
+    }
+    m_pause_condition.notify_all();
+}
+
+bool Wrapper::IsPaused()
+{
+    std::lock_guard<std::mutex> lock(m_pause_mutex);
+    return m_paused;
+}
+
+void Wrapper::SetMaxCatchUpFrames(uint32_t count)
+{
+    m_max_catch_up_frames = count;
+}
+
+void Wrapper::SetThreadPriority(ThreadPriority priority)
+{
+    m_thread_settings.priority = priority;
+}
+
+void Wrapper::SetThreadAffinity(uint64_t affinity_mask)
+{
+    m_thread_settings.affinity_mask = affinity_mask;
+}
+
+void Wrapper::SetJitAllowed(bool allowed)
+{
+    m_thread_settings.allow_jit = allowed;
+}
+
+void Wrapper::SetOutOfProcess(bool out_of_process)
+{
+    m_out_of_process = out_of_process;
+}
+
+void Wrapper::SetPortDevice(uint32_t port, int32_t device)
+{
+    if (port < m_port_devices.size())
+        m_port_devices[port] = std::max(device, InputMapper::s_unbound_device);
+}
+
+void Wrapper::SetRunAhead(uint32_t frames, bool second_instance)
+{
+    m_run_ahead_frames = std::min(frames, 8u);
+    m_run_ahead_second_instance = second_instance;
+}
+
+void Wrapper::SetSlowMotion(float factor)
+{
+    m_slow_motion = Math::clamp(factor, 1.0f, 100.0f);
+}
+
 void Wrapper::_input(const godot::Ref<godot::InputEvent>& event)
 {
-    if (!m_running)
+    if (!m_running || !m_input_enabled)
         return;
 
     Ref<InputEventMouseMotion> mouseMotion = event;
     if (mouseMotion.is_valid())
     {
         auto mouseMotionValue = mouseMotion->get_relative();
-        m_input_handler->SetMousePosition(0, ToShort(mouseMotionValue.x), ToShort(mouseMotionValue.y));
+        m_input_handler->AddMouseMotion(0, ToShort(mouseMotionValue.x), ToShort(mouseMotionValue.y));
     }
 
     Ref<InputEventMouseButton> mouseButton = event;
@@ -429,8 +578,6 @@ void Wrapper::_input(const godot::Ref<godot::InputEvent>& event)
     Ref<InputEventKey> keyEvent = event;
     if (keyEvent.is_valid())
     {
-        auto keys = m_input_handler->GetKeyboardKeys(0);
-
         bool down             = keyEvent->is_pressed();
         uint32_t keycode      = GodotToLibretroKeycode(keyEvent);
         uint32_t character    = keyEvent->get_unicode();
@@ -445,96 +592,64 @@ void Wrapper::_input(const godot::Ref<godot::InputEvent>& event)
         if (mods & KeyModifierMask::KEY_MASK_META)
             keyModifiers |= RETROKMOD_META;
 
-        if (down)
-            keys |= (1 << keycode);
-        else
-            keys &= ~(1 << keycode);
-
-        m_input_handler->SetKeyboardKeys(0, keys);
-
-        m_input_handler->CallKeyboardEventCallback(down, keycode, character, keyModifiers);
+        m_input_handler->SetKey(keycode, down);
+        m_input_handler->QueueKeyEvent(down, keycode, character, keyModifiers);
     }
 }
 
 void Wrapper::_process(double delta)
 {
+    // The thread has unloaded and deinitialized the core on its own, only the Godot side is left
+    if (m_core && m_thread_finished)
+    {
+        ReleaseSession();
+        return;
+    }
+
     if (!m_running)
         return;
 
-    std::unique_ptr<ThreadCommand> command;
-    while (m_main_thread_commands_queue.try_dequeue(command))
-        command->Execute();
+    m_display_clock.Tick();
 
-    auto input = godot::Input::get_singleton();
-
-    uint32_t joypad_buttons = 0;
-
-    if (input->is_action_pressed("RETRO_JOYPAD_B"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_B);
-    if (input->is_action_pressed("RETRO_JOYPAD_Y"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_Y);
-    if (input->is_action_pressed("RETRO_JOYPAD_SELECT"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_SELECT);
-    if (input->is_action_pressed("RETRO_JOYPAD_START"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_START);
-    if (input->is_action_pressed("RETRO_JOYPAD_UP"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_UP);
-    if (input->is_action_pressed("RETRO_JOYPAD_DOWN"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_DOWN);
-    if (input->is_action_pressed("RETRO_JOYPAD_LEFT"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_LEFT);
-    if (input->is_action_pressed("RETRO_JOYPAD_RIGHT"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_RIGHT);
-    if (input->is_action_pressed("RETRO_JOYPAD_A"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_A);
-    if (input->is_action_pressed("RETRO_JOYPAD_X"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_X);
-    if (input->is_action_pressed("RETRO_JOYPAD_L"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_L);
-    if (input->is_action_pressed("RETRO_JOYPAD_R"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_R);
-    if (input->is_action_pressed("RETRO_JOYPAD_L2"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_L2);
-    if (input->is_action_pressed("RETRO_JOYPAD_R2"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_R2);
-    if (input->is_action_pressed("RETRO_JOYPAD_L3"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_L3);
-    if (input->is_action_pressed("RETRO_JOYPAD_R3"))
-        joypad_buttons |= (1 << RETRO_DEVICE_ID_JOYPAD_R3);
-
-    m_input_handler->SetJoypadButtonStates(0, joypad_buttons);
-
-    Vector2 analog_left = {};
-
-    if (input->get_action_strength("RETRO_ANALOG_LEFT_X_NEGATIVE"))
-        analog_left.x -= 1.0f;
-    if (input->get_action_strength("RETRO_ANALOG_LEFT_X_POSITIVE"))
-        analog_left.x += 1.0f;
-    if (input->get_action_strength("RETRO_ANALOG_LEFT_Y_POSITIVE"))
-        analog_left.y -= 1.0f;
-    if (input->get_action_strength("RETRO_ANALOG_LEFT_Y_NEGATIVE"))
-        analog_left.y += 1.0f;
-
-    if (analog_left.length_squared() > 1.0f)
-        analog_left = analog_left.normalized();
-
-    m_input_handler->SetAnalogLeft(0, ToShort(analog_left.x) * 0x7fff, ToShort(analog_left.y) * 0x7fff);
-
-    Vector2 analog_right = {};
-
-    if (input->get_action_strength("RETRO_ANALOG_RIGHT_X_NEGATIVE"))
-        analog_right.x -= 1.0f;
-    if (input->get_action_strength("RETRO_ANALOG_RIGHT_X_POSITIVE"))
-        analog_right.x += 1.0f;
-    if (input->get_action_strength("RETRO_ANALOG_RIGHT_Y_POSITIVE"))
-        analog_right.y -= 1.0f;
-    if (input->get_action_strength("RETRO_ANALOG_RIGHT_Y_NEGATIVE"))
-        analog_right.y += 1.0f;
-
-    if (analog_right.length_squared() > 1.0f)
-        analog_right = analog_right.normalized();
-
-    m_input_handler->SetAnalogRight(0, ToShort(analog_right.x) * 0x7fff, ToShort(analog_right.y) * 0x7fff);
+    m_refresh_rate_query_elapsed -= delta;
+    if (m_refresh_rate_query_elapsed <= 0.0)
+    {
+        auto display_server = DisplayServer::get_singleton();
+        m_display_clock.SetRefreshRate(display_server->screen_get_refresh_rate(display_server->window_get_current_screen()));
+        m_refresh_rate_query_elapsed = 1.0;
+    }
+
+    DrainMainThreadCommands();
+
+    if (!m_input_enabled)
+    {
+        // Released once, otherwise the core keeps seeing whatever was held in the last snapshot until input comes back
+        if (!m_input_cleared)
+        {
+            m_input_handler->ClearPending();
+            m_input_handler->Publish();
+            m_input_cleared = true;
+        }
+        return;
+    }
+    m_input_cleared = false;
+
+    m_input_mapper->Update(*m_input_handler, m_port_devices);
+
+    // Also carries the mouse buttons and keys _input set since the last frame
+    m_input_handler->Publish();
+}
+
+void Wrapper::RequestStop()
+{
+    if (!m_core)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_pause_mutex);
+        m_running = false;
+    }
+    m_pause_condition.notify_all();
 }
 
 void Wrapper::StopEmulationThread()
@@ -544,62 +659,261 @@ void Wrapper::StopEmulationThread()
         return;
     }
 
-    m_running = false;
-    m_thread.join();
+    RequestStop();
+    ReleaseSession();
+}
+
+void Wrapper::ReleaseSession()
+{
+    // Instant when the thread already reported it finished, otherwise waits for retro_unload_game and retro_deinit
+    if (m_thread.joinable())
+        m_thread.join();
+    m_thread_finished = false;
+
+    // Anything queued in either direction after the thread stopped is stale now
+    m_main_thread_commands.Clear();
+    m_command_queue_depth = 0;
+    std::unique_ptr<ThreadCommand> command;
+    while (m_emulation_thread_commands_queue.try_dequeue(command));
+    m_emulation_commands_pending = false;
 
     m_video_handler->DeInit();
     m_audio_handler->DeInit();
 
     m_core->Unload();
+    m_remote_core = nullptr;
 
+    m_session = {};
+    m_session.wrapper = this;
     m_core = nullptr;
     m_environment_handler = nullptr;
     m_video_handler = nullptr;
     m_audio_handler = nullptr;
     m_input_handler = nullptr;
+    m_input_mapper = nullptr;
     m_options_handler = nullptr;
     m_message_handler = nullptr;
     m_log_handler = nullptr;
 
     m_node = nullptr;
+
+    Libretro::NotifyContentStopped(*this);
 }
 
 void Wrapper::EmulationThreadLoop()
+{
+    {
+        // Bound before retro_init so every callback made on this thread finds its session directly
+        SessionScope scope(*this);
+        RunSession();
+    }
+
+    // Picked up by the next _process, which releases everything owned by the main thread
+    m_thread_finished = true;
+}
+
+void Wrapper::RunSession()
 {
     Log("Libretro Thread starting...");
 
-    if (!m_core->Load())
+    m_session_thread_settings.ApplyToCurrentThread();
+
+    retro_system_av_info systemAvInfo = {};
+    if (m_session_out_of_process)
+    {
+        if (!StartRemoteCore())
+            return;
+        systemAvInfo = m_remote_core->GetAvInfo();
+    }
+    else
+    {
+        if (!m_core->Load())
+            return;
+
+        if (!LoadGame())
+            return;
+        m_game_loaded = true;
+
+        m_core->retro_get_system_av_info(&systemAvInfo);
+    }
+
+    m_run_ahead.Reset();
+
+    Log("FPS: " + std::to_string(systemAvInfo.timing.fps) + " Sample Rate: " + std::to_string(systemAvInfo.timing.sample_rate));
+
+    if (!m_video_handler->InitHwRenderContext(systemAvInfo.geometry.base_width, systemAvInfo.geometry.base_height))
+    {
+        LogError("Failed to initialize video");
         return;
+    }
 
-    if (m_game_path.empty())
+    m_running = true;
+
+    InitAudio(systemAvInfo.timing.sample_rate);
+
+    // get_system_av_info is authoritative, anything the core announced while loading is already part of it
+    m_pending_av_info.reset();
+
+    m_core_fps = systemAvInfo.timing.fps;
+    m_frame_scheduler.SetRate(m_core_fps);
+    m_frame_scheduler.Reset();
+    bool core_produced_audio = false;
+    float speed_ratio = 1.0f;
+    float slow_motion = 1.0f;
+    double scheduled_fps = m_core_fps;
+    uint64_t display_tick = 0;
+    auto last_present_time = FrameScheduler::Clock::now();
+    auto present_interval = std::chrono::duration_cast<FrameScheduler::Clock::duration>(std::chrono::duration<double>(1.0 / m_core_fps));
+
+    Libretro::NotifyOptionsReady(*this);
+
+    m_content_start_usec = std::chrono::duration_cast<std::chrono::microseconds>(FrameScheduler::Clock::now() - m_content_start_time).count();
+    Log("Content started in " + std::to_string(m_content_start_usec / 1000.0) + " ms");
+
+    while (m_running)
     {
-        if (!m_core->GetSupportsNoGame())
+        bool stepping = WaitWhilePaused();
+        if (!m_running)
+            break;
+
+        RunEmulationCommands();
+        if (!m_running)
+            break;
+
+        float new_speed_ratio = GetSpeedRatio();
+        float new_slow_motion = m_slow_motion;
+        if (new_speed_ratio != speed_ratio || new_slow_motion != slow_motion || m_core_fps != scheduled_fps)
         {
-            LogError("Game not set and this core does not support no game mode.");
-            return;
+            // A core fps change keeps the current deadline, only user speed changes restart the timeline
+            if (new_speed_ratio != speed_ratio || new_slow_motion != slow_motion)
+                m_frame_scheduler.Reset();
+
+            speed_ratio = new_speed_ratio;
+            slow_motion = new_slow_motion;
+            scheduled_fps = m_core_fps;
+            m_frame_scheduler.SetRate(m_core_fps * std::max(speed_ratio, 1.0f) / slow_motion);
+            present_interval = std::chrono::duration_cast<FrameScheduler::Clock::duration>(std::chrono::duration<double>(1.0 / m_core_fps));
         }
 
-        retro_game_info game_info = {};
+        bool real_time = speed_ratio == 1.0f && slow_motion == 1.0f && !stepping;
 
-        if (!m_core->retro_load_game(&game_info))
+        uint32_t display_divisor = 1;
+        double display_speed = 1.0;
+        if (m_pacing_mode == PacingMode::Display && real_time && GetDisplayLock(display_divisor, display_speed))
         {
-            LogError("Failed to load game");
-            return;
+            if (m_display_locked_rate == 0.0)
+                display_tick = m_display_clock.GetTicks();
+
+            m_display_locked_rate = m_core_fps * display_speed;
+            // Whatever the nominal rate gets wrong shows up as a slow drift in the buffer fill, that is what corrects it
+            m_audio_handler->SetRateAdjust(display_speed * m_audio_handler->GetRateControl(m_audio_target_fill));
+
+            // Running behind the display drops the backlog, a stalled main thread (minimized, loading) times out and resyncs
+            display_tick += display_divisor;
+            uint64_t ticks = m_display_clock.GetTicks();
+            if (ticks > display_tick + display_divisor)
+                display_tick = ticks;
+            else if (!m_display_clock.WaitForTicks(display_tick, std::chrono::milliseconds(100)))
+                display_tick = m_display_clock.GetTicks();
+            if (!m_running)
+                break;
+
+            core_produced_audio = RunFrame(true, true);
+
+            m_frame_scheduler.Reset();
+            m_frame_scheduler.Advance();
+            continue;
+        }
+
+        if (m_display_locked_rate != 0.0)
+        {
+            m_display_locked_rate = 0.0;
+            m_audio_handler->SetRateAdjust(1.0);
+            m_frame_scheduler.Reset();
+        }
+
+        // Cores that stay silent (or haven't produced audio yet) can't be paced by the audio clock, fall back to the timer for those frames
+        if (m_pacing_mode == PacingMode::Audio && core_produced_audio && real_time)
+        {
+            m_audio_handler->WaitForBufferBelow(m_audio_target_fill);
+
+            core_produced_audio = RunFrame(true, true);
+
+            // Should the core go silent the timer picks up one period after this frame
+            m_frame_scheduler.Reset();
+            m_frame_scheduler.Advance();
+            continue;
+        }
+
+        if (speed_ratio >= 1.0f && !stepping)
+            m_frame_scheduler.WaitForNextFrame();
+        if (!m_running)
+            break;
+
+        // While fast-forwarding only frames that land on a new display interval get converted and uploaded
+        bool present = true;
+        if (speed_ratio != 1.0f && !stepping)
+        {
+            auto now = FrameScheduler::Clock::now();
+            present = now - last_present_time >= present_interval;
+            if (present)
+                last_present_time = now;
         }
+        else if (!stepping)
+        {
+            // Catch up a bounded number of frames with video off, anything beyond that is dropped so a slow frame can't snowball
+            uint64_t frames_behind = m_frame_scheduler.GetFramesBehind();
+            if (frames_behind > m_max_catch_up_frames)
+            {
+                m_dropped_frames.fetch_add(frames_behind, std::memory_order_relaxed);
+                m_frame_scheduler.Reset();
+            }
+            else if (frames_behind > 0)
+            {
+                m_skipped_frames.fetch_add(1, std::memory_order_relaxed);
+                present = false;
+            }
+        }
+
+        core_produced_audio = RunFrame(real_time, present);
+        m_frame_scheduler.Advance();
+    }
+
+    m_audio_handler->StopAudioCallback();
+
+    if (m_remote_core)
+    {
+        m_remote_core->Stop();
     }
     else
+    {
+        m_run_ahead.Shutdown(*this);
+
+        if (m_game_loaded)
+            m_core->retro_unload_game();
+        m_game_loaded = false;
+        m_core->retro_deinit();
+    }
+
+    m_running = false;
+    Log("Libretro thread stopped.");
+}
+
+bool Wrapper::LoadGame()
+{
+    if (!m_game_path.empty())
     {
         if (!std::filesystem::is_regular_file(m_game_path))
         {
             LogError("Game not found: " + m_game_path);
-            return;
+            return false;
         }
 
         std::ifstream file(m_game_path, std::ios::binary | std::ios::ate);
         if (!file)
         {
             LogError("Failed to open game file: " + m_game_path);
-            return;
+            return false;
         }
 
         size_t game_size = static_cast<size_t>(file.tellg());
@@ -609,89 +923,414 @@ void Wrapper::EmulationThreadLoop()
         if (!file.read(reinterpret_cast<char*>(m_game_buffer.data()), game_size))
         {
             LogError("Failed to read game file: " + m_game_path);
-            return;
+            return false;
         }
+    }
+
+    return LoadGameInto(*m_core);
+}
+
+bool Wrapper::LoadGameInto(Core& core)
+{
+    retro_game_info game_info = {};
 
-        retro_game_info game_info = {};
+    if (m_game_path.empty())
+    {
+        // Asked through the primary, it is the only instance whose environment calls are applied
+        if (!m_core->GetSupportsNoGame())
+        {
+            LogError("Game not set and this core does not support no game mode.");
+            return false;
+        }
+    }
+    else
+    {
         game_info.path = m_game_path.c_str();
         game_info.data = reinterpret_cast<const void*>(m_game_buffer.data());
-        game_info.size = game_size;
+        game_info.size = m_game_buffer.size();
         game_info.meta = nullptr;
+    }
+
+    if (!core.retro_load_game(&game_info))
+    {
+        LogError("Failed to load game");
+        return false;
+    }
+
+    return true;
+}
+
+bool Wrapper::StartRemoteCore()
+{
+    m_remote_core = std::make_unique<RemoteCore>();
+    if (!m_remote_core->Start(m_remote_launch_info))
+    {
+        LogError("Failed to start the core out of process: " + m_remote_launch_info.core_path);
+        return false;
+    }
+
+    Log("Core running out of process: " + m_remote_launch_info.core_path);
+    return true;
+}
+
+void Wrapper::RunRemoteFrame()
+{
+    // The host can't call back, latch here what PollCallback would and hand the core the whole snapshot
+    m_input_handler->Latch();
+    for (uint32_t port = 0; port < InputHandler::s_max_ports; port++)
+    {
+        const auto& state = m_input_handler->GetLatchedPort(port);
+        m_remote_core->SetInput(port, state.joypad_buttons,
+                                state.analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_X], state.analog[RETRO_DEVICE_INDEX_ANALOG_LEFT][RETRO_DEVICE_ID_ANALOG_Y],
+                                state.analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_X], state.analog[RETRO_DEVICE_INDEX_ANALOG_RIGHT][RETRO_DEVICE_ID_ANALOG_Y]);
+    }
 
-        if (!m_core->retro_load_game(&game_info))
+    bool ran = m_remote_core->RunFrame();
+    m_ipc_overhead_usec = m_remote_core->GetIpcOverheadUsec();
+    m_host_restarts = m_remote_core->GetRestarts();
+
+    if (!ran)
+    {
+        // A restarted host comes back with the game reloaded, one that keeps crashing ends the session
+        if (!m_remote_core->IsAlive())
         {
-            LogError("Failed to load game");
-            return;
+            LogError("Core host gave up, stopping session.");
+            m_running = false;
         }
+        return;
     }
 
-    retro_system_av_info systemAvInfo = {};
-    m_core->retro_get_system_av_info(&systemAvInfo);
+    uint32_t width = 0;
+    uint32_t height = 0;
+    const uint8_t* frame = m_remote_core->GetFrame(width, height);
+    if (frame && m_session.present_frame)
+        m_video_handler->PresentRgba8(frame, width, height);
 
-    Log("FPS: " + std::to_string(systemAvInfo.timing.fps) + " Sample Rate: " + std::to_string(systemAvInfo.timing.sample_rate));
+    size_t audio_frames = 0;
+    const int16_t* audio = m_remote_core->GetAudio(audio_frames);
+    if (audio_frames > 0)
+        AudioHandler::SampleBatchCallback(audio, audio_frames);
+}
 
-    if (!m_video_handler->InitHwRenderContext(systemAvInfo.geometry.base_width, systemAvInfo.geometry.base_height))
+bool Wrapper::RunFrame(bool real_time, bool present)
+{
+    uint64_t pushed_frames = m_audio_handler->GetPushedFrames();
+
+    m_session.present_frame = present;
+    m_session.drop_audio = !real_time;
+    m_audio_handler->SetDropAudio(m_session.drop_audio);
+
+    m_environment_handler->CallFrameTimeCallback(!real_time);
+    m_audio_handler->CallAudioBufferStatusCallback();
+
+    auto run_start = FrameScheduler::Clock::now();
+    // Frames that aren't shown or aren't real time gain nothing from running ahead
+    uint32_t run_ahead_frames = m_run_ahead_frames.load(std::memory_order_relaxed);
+    if (m_remote_core)
+        RunRemoteFrame();
+    else if (run_ahead_frames > 0 && present && real_time)
+        m_run_ahead.RunFrame(*this, run_ahead_frames, m_run_ahead_second_instance, present);
+    else
     {
-        LogError("Failed to initialize video");
-        return;
+        if (run_ahead_frames == 0)
+            m_run_ahead.ReleaseSecondInstance(*this);
+        m_core->retro_run();
     }
+    double run_usec = std::chrono::duration<double, std::micro>(FrameScheduler::Clock::now() - run_start).count();
+    m_run_usec = m_run_usec > 0.0 ? m_run_usec * 0.95 + run_usec * 0.05 : run_usec;
 
-    m_running = true;
+    m_audio_handler->EndFrame();
+    m_frames_run.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_pending_av_info)
+        ApplySystemAvInfo();
+
+    if (m_audio_handler->GetResizeRequested())
+        InitAudio(m_audio_handler->GetSampleRate());
+
+    return m_audio_handler->GetPushedFrames() != pushed_frames;
+}
+
+void Wrapper::ApplySystemAvInfo()
+{
+    retro_system_av_info av_info = *m_pending_av_info;
+    m_pending_av_info.reset();
+
+    m_video_handler->ApplyGeometry(av_info.geometry);
 
+    // The loop reschedules on the next iteration
+    if (av_info.timing.fps > 0.0 && av_info.timing.fps != m_core_fps)
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        m_mutex_done = false;
-        m_main_thread_commands_queue.enqueue(std::make_unique<ThreadCommandInitAudio>(0.1f, systemAvInfo.timing.sample_rate));
-        m_condition_variable.wait(lock, [&]{ return m_mutex_done; });
+        Log("Core fps changed: " + std::to_string(m_core_fps) + " -> " + std::to_string(av_info.timing.fps));
+        m_core_fps = av_info.timing.fps;
+    }
+
+    // Rebuilds the generator, resampler and DSP filter for the new input rate
+    if (av_info.timing.sample_rate > 0.0 && av_info.timing.sample_rate != m_audio_handler->GetSampleRate())
+    {
+        Log("Core sample rate changed: " + std::to_string(m_audio_handler->GetSampleRate()) + " -> " + std::to_string(av_info.timing.sample_rate));
+        InitAudio(av_info.timing.sample_rate);
     }
+}
+
+static constexpr double s_display_lock_tolerance = 0.005;
+static constexpr uint32_t s_display_lock_max_divisor = 4;
 
-    double frame_duration_ms = 1000.0 / systemAvInfo.timing.fps;
-    auto last_time = std::chrono::steady_clock::now();
-    double accumulator = 0.0;
+bool Wrapper::GetDisplayLock(uint32_t& divisor, double& speed)
+{
+    double refresh_rate = m_display_clock.GetRefreshRate();
+    double measured_rate = m_display_clock.GetMeasuredRate();
+    if (refresh_rate <= 0.0 || measured_rate <= 0.0 || m_core_fps <= 0.0)
+        return false;
 
-    Libretro::NotifyOptionsReady();
+    // _process only follows the display with vsync on, a free running main thread is no clock
+    if (std::abs(measured_rate - refresh_rate) / refresh_rate > 0.05)
+        return false;
 
-    while (m_running)
+    // The nominal rate, the measured one carries every bit of _process jitter straight into the audio pitch
+    for (uint32_t d = 1; d <= s_display_lock_max_divisor; d++)
     {
-        if (!m_running)
+        double display_fps = refresh_rate / d;
+        if (std::abs(display_fps / m_core_fps - 1.0) <= s_display_lock_tolerance)
+        {
+            divisor = d;
+            speed = display_fps / m_core_fps;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Wrapper::WaitWhilePaused()
+{
+    std::unique_lock<std::mutex> lock(m_pause_mutex);
+
+    if (!m_paused && !m_was_paused)
+        return false;
+
+    if (m_paused && !m_was_paused)
+    {
+        m_was_paused = true;
+        m_audio_handler->SetPaused(true);
+    }
+
+    // Nothing runs and nothing spins until Resume, StepFrames or StopContent wakes us, LoadContent and Reset are served in place
+    while (true)
+    {
+        m_pause_condition.wait(lock, [&]{ return !m_paused || m_step_frames > 0 || !m_running || m_emulation_commands_pending; });
+        if (!m_paused || m_step_frames > 0 || !m_running)
             break;
 
-        auto now = std::chrono::steady_clock::now();
-        double elapsed = std::chrono::duration<double, std::milli>(now - last_time).count();
-        last_time = now;
-        accumulator += elapsed;
+        lock.unlock();
+        RunEmulationCommands();
+        lock.lock();
+    }
+
+    if (!m_paused)
+    {
+        m_was_paused = false;
+        m_audio_handler->SetPaused(false);
+        m_environment_handler->ResetFrameTimeBaseline();
+        m_frame_scheduler.Reset();
+        return false;
+    }
+
+    // The time spent paused, or since the previous step, is not game time
+    if (m_step_frames > 0)
+    {
+        m_step_frames--;
+        m_environment_handler->ResetFrameTimeBaseline();
+        return true;
+    }
+
+    return false;
+}
+
+void Wrapper::EnqueueEmulationCommand(std::unique_ptr<ThreadCommand> command)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pause_mutex);
+        m_emulation_thread_commands_queue.enqueue(std::move(command));
+        m_emulation_commands_pending = true;
+    }
+    m_pause_condition.notify_all();
+}
+
+void Wrapper::RunEmulationCommands()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pause_mutex);
+        if (!m_emulation_commands_pending)
+            return;
+        m_emulation_commands_pending = false;
+    }
+
+    std::unique_ptr<ThreadCommand> command;
+    while (m_running && m_emulation_thread_commands_queue.try_dequeue(command))
+        command->Execute();
+}
+
+void Wrapper::SwapContent(const std::string& game_path)
+{
+    auto start = FrameScheduler::Clock::now();
 
-        while (accumulator >= frame_duration_ms)
+    m_game_path = game_path;
+    retro_system_av_info av_info = {};
+    if (m_remote_core)
+    {
+        // The host loads its game at startup, swapping means a fresh host. The core file stays in the OS cache so this is still cheap
+        m_remote_core->Stop();
+        m_remote_launch_info.game_path = game_path;
+        if (!StartRemoteCore())
         {
-            m_audio_handler->CallAudioBufferStatusCallback();
+            LogError("Failed to swap content, stopping session.");
+            m_running = false;
+            return;
+        }
+        av_info = m_remote_core->GetAvInfo();
+    }
+    else
+    {
+        // Loaded again with the new content the next time it runs ahead
+        m_run_ahead.ReleaseSecondInstance(*this);
 
-            m_core->retro_run();
+        // The audio callback thread calls into the core, it must be quiet while the game goes away
+        m_audio_handler->StopAudioCallback();
 
-            accumulator -= frame_duration_ms;
+        if (m_game_loaded)
+            m_core->retro_unload_game();
+        m_game_loaded = false;
+
+        // Whatever the new game registers while loading replaces these, anything it doesn't must not outlive the old one
+        m_audio_handler->ClearAudioCallback();
+        m_environment_handler->ResetGameCallbacks();
+
+        if (!LoadGame())
+        {
+            LogError("Failed to swap content, stopping session.");
+            m_running = false;
+            return;
         }
-    }    
-    m_core->retro_unload_game();
-    m_core->retro_deinit();
+        m_game_loaded = true;
 
-    m_running = false;
-    Log("Libretro thread stopped.");
+        m_core->retro_get_system_av_info(&av_info);
+    }
+
+    // Same path as a runtime SET_SYSTEM_AV_INFO, the audio player and textures are only rebuilt if something actually changed
+    m_pending_av_info = av_info;
+    ApplySystemAvInfo();
+
+    // No-op unless the new game registered an audio callback and ApplySystemAvInfo didn't already restart it
+    m_audio_handler->StartAudioCallback();
+
+    m_frame_scheduler.Reset();
+
+    m_content_switch_usec = std::chrono::duration_cast<std::chrono::microseconds>(FrameScheduler::Clock::now() - start).count();
+    Log("Content switched in " + std::to_string(m_content_switch_usec / 1000.0) + " ms");
+}
+
+void Wrapper::InitAudio(double sample_rate)
+{
+    // Generator and player must be touched on the main thread, block at this frame boundary until it has been (re)built
+    m_audio_handler->StopAudioCallback();
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_mutex_done = false;
+        if (!PushMainThreadCommand(ThreadCommandInitAudio(m_audio_latency_sec, sample_rate), false))
+            return;
+        while (!m_condition_variable.wait_for(lock, std::chrono::milliseconds(10), [&]{ return m_mutex_done; }))
+            if (!m_running)
+                return;
+    }
+
+    m_audio_handler->StartAudioCallback();
 }
 
 void Wrapper::CreateTexture(Image::Format image_format, PackedByteArray pixel_data, int32_t width, int32_t height, bool flip_y)
 {
     m_video_handler->SetImageFormat(image_format);
-    m_main_thread_commands_queue.enqueue(std::make_unique<ThreadCommandCreateTexture>(image_format, pixel_data, width, height, flip_y));
+    PushMainThreadCommand(ThreadCommandCreateTexture(image_format, pixel_data, width, height, flip_y), false);
 }
 
 void Wrapper::UpdateTexture(PackedByteArray pixel_data, bool flip_y)
 {
-    m_main_thread_commands_queue.enqueue(std::make_unique<ThreadCommandUpdateTexture>(pixel_data, flip_y));
+    // A newer frame is always coming, losing this one beats stalling the core on a busy main thread
+    PushMainThreadCommand(ThreadCommandUpdateTexture(pixel_data, flip_y), true);
+}
+
+bool Wrapper::PushMainThreadCommand(MainThreadCommand&& command, bool droppable)
+{
+    while (!m_main_thread_commands.TryPush(std::move(command)))
+    {
+        if (droppable || !m_running)
+        {
+            m_commands_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+
+    uint32_t depth = static_cast<uint32_t>(m_main_thread_commands.Size());
+    m_command_queue_depth.store(depth, std::memory_order_relaxed);
+    if (depth > m_command_queue_peak_depth.load(std::memory_order_relaxed))
+        m_command_queue_peak_depth.store(depth, std::memory_order_relaxed);
+    return true;
+}
+
+void Wrapper::DrainMainThreadCommands()
+{
+    auto start = FrameScheduler::Clock::now();
+    auto budget = std::chrono::microseconds(m_command_budget_usec.load(std::memory_order_relaxed));
+
+    while (MainThreadCommand* front = m_main_thread_commands.Front())
+    {
+        // Taken out before Pop so the slot is free for the producer while the command runs
+        MainThreadCommand command = std::move(*front);
+        m_main_thread_commands.Pop();
+
+        // Only the newest of several queued frames is worth uploading
+        MainThreadCommand* next = m_main_thread_commands.Front();
+        if (next && std::holds_alternative<ThreadCommandUpdateTexture>(command) && std::holds_alternative<ThreadCommandUpdateTexture>(*next))
+        {
+            m_commands_coalesced.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::visit([](auto& value)
+        {
+            if constexpr (!std::is_same_v<std::decay_t<decltype(value)>, std::monostate>)
+                value.Execute();
+        }, command);
+        m_commands_executed.fetch_add(1, std::memory_order_relaxed);
+
+        if (budget.count() > 0 && FrameScheduler::Clock::now() - start >= budget)
+        {
+            if (m_main_thread_commands.Front())
+                m_commands_deferred.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    uint64_t drain_usec = std::chrono::duration_cast<std::chrono::microseconds>(FrameScheduler::Clock::now() - start).count();
+    m_command_drain_usec.store(drain_usec, std::memory_order_relaxed);
+    if (drain_usec > m_command_drain_peak_usec.load(std::memory_order_relaxed))
+        m_command_drain_peak_usec.store(drain_usec, std::memory_order_relaxed);
+    m_command_queue_depth.store(static_cast<uint32_t>(m_main_thread_commands.Size()), std::memory_order_relaxed);
+}
+
+void Wrapper::SetCommandBudget(uint32_t budget_usec)
+{
+    m_command_budget_usec = budget_usec;
 }
 
 bool Wrapper::Shutdown()
 {
+    // Called from retro_run on the emulation thread, so only ask the loop to end, joining here would join ourselves
     Log("Shutting down from core...");
-    StopEmulationThread();
+    RequestStop();
     return true;
 }
 
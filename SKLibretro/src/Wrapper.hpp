@@ -7,12 +7,14 @@
 #include <godot_cpp/classes/input_event.hpp>
 
 #include <thread>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <string>
 #include <vector>
 #include <queue>
 #include <unordered_map>
+#include <optional>
 
 #include <SDL3/SDL_video.h>
 
@@ -20,57 +22,196 @@
 #include <readerwriterqueue.h>
 
 #include "ThreadCommand.hpp"
+#include "MainThreadCommand.hpp"
+#include "CommandRing.hpp"
 #include "Core.hpp"
+#include "RemoteCore.hpp"
 #include "EnvironmentHandler.hpp"
 #include "VideoHandler.hpp"
 #include "AudioHandler.hpp"
 #include "InputHandler.hpp"
+#include "InputMapper.hpp"
 #include "OptionsHandler.hpp"
 #include "MessageHandler.hpp"
 #include "LogHandler.hpp"
+#include "FrameScheduler.hpp"
+#include "ThreadSettings.hpp"
+#include "DisplayClock.hpp"
+#include "RunAhead.hpp"
 
 class SDL_Window;
 
 namespace SK
 {
+enum class PacingMode : uint32_t
+{
+    Timer = 0,  // FrameScheduler deadlines at the core's fps
+    Audio = 1,  // block until the audio buffer drains below the target fill
+    Display = 2 // one retro_run per rendered frame (or every Nth) when the refresh rate is close enough, timer otherwise
+};
+
+class Wrapper;
+
+// Everything the libretro callbacks touch per frame, filled once per session so they reach it without locks or pointer chains
+struct alignas(64) SessionContext
+{
+    Wrapper* wrapper = nullptr;
+    VideoHandler* video = nullptr;
+    AudioHandler* audio = nullptr;
+    InputHandler* input = nullptr;
+    EnvironmentHandler* environment = nullptr;
+    // Per frame decisions made by RunFrame, read by the callbacks and GET_AUDIO_VIDEO_ENABLE during retro_run
+    bool present_frame = true;
+    bool drop_audio = false;
+    // Run-ahead: frames that will be rolled back, the second core instance being called, what a serialize is for
+    bool speculative = false;
+    bool secondary_core = false;
+    retro_savestate_context savestate_context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+};
+
 class Wrapper
 {
 public:
+    // Every LibretroPlayer owns one, the Libretro singleton API drives the default instance
+    Wrapper();
     ~Wrapper() = default;
 
     static Wrapper* GetInstance();
+    // The session bound to the calling thread by a SessionScope, the default instance's otherwise
+    // Threads a core spawns on its own are not bound, their callbacks only reach the right session for the default instance
+    static SessionContext* GetSession() { return s_current_session ? s_current_session : &GetInstance()->m_session; }
+    static Wrapper* GetCurrent() { return GetSession()->wrapper; }
 
     void StartContent(godot::MeshInstance3D* node, const std::string& root_directory, const std::string& core_name, const std::string& game_path);
-    void StopContent();
+    // Returns right away unless wait is set, the core unloads on the emulation thread and content_stopped follows
+    void StopContent(bool wait = false);
+    // Keeps the core loaded and swaps only the game, served by the emulation thread at the next frame boundary
+    void LoadContent(const std::string& game_path);
+    void Reset();
 
     const std::unordered_map<std::string, OptionCategory>& GetOptionCategories() const { return m_options_handler->GetCategories(); }
     const std::unordered_map<std::string, OptionDefinition>& GetOptionDefinitions() const { return m_options_handler->GetDefinitions(); }
     const std::unordered_map<std::string, std::string>& GetOptionValues() const { return m_options_handler->GetValues(); }
     void SetCoreOption(const std::string& key, const std::string& value);
+    void SetPacingMode(PacingMode mode, float audio_target_fill);
+    void SetAudioDspFilter(const std::string& path);
+    void SetAudioLatency(float latency_sec);
+    void SetAudioResamplerQuality(int32_t quality);
+    void SetFastForward(float ratio);
+    void Pause();
+    void Resume();
+    // Runs count frames and stays paused, pausing first if needed
+    void StepFrames(uint32_t count);
+    bool IsPaused();
+    // 1 is normal speed, 2 is half speed and so on
+    void SetSlowMotion(float factor);
+    // Frames the timer loop may run back to back, with video off, before giving up on the backlog
+    void SetMaxCatchUpFrames(uint32_t count);
+    // Thread settings are picked up by the next StartContent
+    void SetThreadPriority(ThreadPriority priority);
+    void SetThreadAffinity(uint64_t affinity_mask);
+    void SetJitAllowed(bool allowed);
+    // Runs the core in a separate sklibretro_host process, picked up by the next StartContent
+    void SetOutOfProcess(bool out_of_process);
+    // Device -1 feeds the port from the RETRO_* actions, -2 leaves it idle, anything else is a Godot joypad device id
+    void SetPortDevice(uint32_t port, int32_t device);
+    // Frames to run ahead of the real one to hide the core's input lag, 0 turns it off
+    // The second instance keeps the primary core from ever rolling back, at the cost of loading the core twice
+    void SetRunAhead(uint32_t frames, bool second_instance);
+    // Speed the loop runs at: 1 is the core's fps, above 1 a multiple of it, below 1 unthrottled
+    float GetSpeedRatio() const;
 
     void _input(const godot::Ref<godot::InputEvent>& event);
     void _process(double delta);
 
     godot::MeshInstance3D* m_node;
+    // Receives options_ready and content_stopped, the Libretro singleton when null
+    godot::Object* m_owner = nullptr;
+    // Off for screens that should only be watched, not played
+    bool m_input_enabled = true;
+    // Set once the pending input was released after m_input_enabled went off
+    bool m_input_cleared = false;
+    // Godot joypad device per libretro port, see InputMapper
+    InputMapper::PortDevices m_port_devices = InputMapper::s_default_port_devices;
 
     const std::string& GetRootDirectory() const { return m_root_directory; }
     const std::string& GetTempDirectory() const { return m_temp_directory; }
 
     std::unique_ptr<Core> m_core = nullptr;
+    // Only set for out of process sessions, m_core then stays unloaded
+    std::unique_ptr<RemoteCore> m_remote_core = nullptr;
     std::unique_ptr<EnvironmentHandler> m_environment_handler = nullptr;
     std::unique_ptr<VideoHandler> m_video_handler = nullptr;
     std::unique_ptr<AudioHandler> m_audio_handler = nullptr;
     std::unique_ptr<InputHandler> m_input_handler = nullptr;
+    std::unique_ptr<InputMapper> m_input_mapper = nullptr;
     std::unique_ptr<OptionsHandler> m_options_handler = nullptr;
     std::unique_ptr<MessageHandler> m_message_handler = nullptr;
     std::unique_ptr<LogHandler> m_log_handler = nullptr;
 
     std::thread m_thread;
-    moodycamel::ReaderWriterQueue<std::unique_ptr<ThreadCommand>> m_main_thread_commands_queue;
+    std::atomic<bool> m_thread_finished = false;
+    ThreadSettings m_thread_settings;
+    ThreadSettings m_session_thread_settings;
+    std::atomic<bool> m_out_of_process = false;
+    bool m_session_out_of_process = false;
+    RemoteCore::LaunchInfo m_remote_launch_info;
+    FrameScheduler m_frame_scheduler;
+    DisplayClock m_display_clock;
+    double m_refresh_rate_query_elapsed = 0.0;
+    std::atomic<double> m_display_locked_rate = 0.0;
+    CommandRing<MainThreadCommand, 16> m_main_thread_commands;
+    // 0 drains everything every _process
+    std::atomic<uint32_t> m_command_budget_usec = 2000;
+    std::atomic<uint32_t> m_command_queue_depth = 0;
+    std::atomic<uint32_t> m_command_queue_peak_depth = 0;
+    std::atomic<uint64_t> m_command_drain_usec = 0;
+    std::atomic<uint64_t> m_command_drain_peak_usec = 0;
+    std::atomic<uint64_t> m_commands_executed = 0;
+    std::atomic<uint64_t> m_commands_coalesced = 0;
+    std::atomic<uint64_t> m_commands_deferred = 0;
+    std::atomic<uint64_t> m_commands_dropped = 0;
+    moodycamel::ReaderWriterQueue<std::unique_ptr<ThreadCommand>> m_emulation_thread_commands_queue;
+    bool m_emulation_commands_pending = false;
+    bool m_game_loaded = false;
+    FrameScheduler::Clock::time_point m_content_start_time = {};
+    std::atomic<int64_t> m_content_start_usec = 0;
+    std::atomic<int64_t> m_content_switch_usec = 0;
     std::mutex m_mutex;
     bool m_mutex_done = false;
     std::condition_variable m_condition_variable;
-    bool m_running = false;
+    // Written from the main thread (StopContent, RequestStop) and read by the emulation and audio callback threads
+    std::atomic<bool> m_running = false;
+
+    std::atomic<PacingMode> m_pacing_mode = PacingMode::Timer;
+    std::atomic<float> m_audio_target_fill = 0.5f;
+    std::string m_audio_dsp_filter_path;
+    std::atomic<float> m_audio_latency_sec = 0.1f;
+    // 0 leaves resampling to Godot, 1 (lowest) to 5 (highest) select the sinc resampler tier
+    std::atomic<int32_t> m_audio_resampler_quality = 3;
+    std::atomic<float> m_fast_forward_ratio = 1.0f;
+    std::atomic<float> m_slow_motion = 1.0f;
+    std::mutex m_pause_mutex;
+    std::condition_variable m_pause_condition;
+    bool m_paused = false;
+    bool m_was_paused = false;
+    uint32_t m_step_frames = 0;
+    std::atomic<uint32_t> m_max_catch_up_frames = 5;
+    std::atomic<uint64_t> m_skipped_frames = 0;
+    std::atomic<uint64_t> m_dropped_frames = 0;
+    std::atomic<uint64_t> m_frames_run = 0;
+    // Averaged time retro_run took as seen from the emulation thread, including the round trip when out of process
+    std::atomic<double> m_run_usec = 0.0;
+    std::atomic<double> m_ipc_overhead_usec = 0.0;
+    std::atomic<uint32_t> m_host_restarts = 0;
+    std::atomic<uint32_t> m_run_ahead_frames = 0;
+    std::atomic<bool> m_run_ahead_second_instance = false;
+    RunAhead m_run_ahead;
+    double m_core_fps = 0.0;
+    // Set by SET_SYSTEM_AV_INFO during retro_run, applied once it returns
+    std::optional<retro_system_av_info> m_pending_av_info;
+    SessionContext m_session;
+    static thread_local SessionContext* s_current_session;
 
     std::string m_root_directory;
     std::string m_temp_directory;
@@ -78,23 +219,66 @@ public:
     retro_log_level m_log_level = RETRO_LOG_WARN;
 
     std::string m_game_path;
+    // The core as found in the cores directory, m_core itself runs from a temp copy
+    std::string m_core_path;
 
     std::vector<unsigned char> m_game_buffer;
 
+    // Safe from any thread, including from inside retro_run
+    void RequestStop();
+    // Main thread only, blocks until the thread is gone
     void StopEmulationThread();
+    void ReleaseSession();
     void EmulationThreadLoop();
+    void RunSession();
+    // Runs one retro_run with its per-frame callbacks around it, returns whether the core produced audio
+    // Frames that are not real time (fast-forward, slow motion, steps) drop audio and report the reference frame time
+    bool RunFrame(bool real_time, bool present);
+    // Blocks while paused, returns true when the frame about to run is a single step
+    bool WaitWhilePaused();
+    void ApplySystemAvInfo();
+    // Reads the content and loads it into the primary core
+    bool LoadGame();
+    // Loads the content LoadGame already read into any instance of the core
+    bool LoadGameInto(Core& core);
+    bool StartRemoteCore();
+    // RunFrame's out of process counterpart, input goes into the shared block and video and audio come back out of it
+    void RunRemoteFrame();
+    void EnqueueEmulationCommand(std::unique_ptr<ThreadCommand> command);
+    void RunEmulationCommands();
+    void SwapContent(const std::string& game_path);
+    // Finds the display divisor whose rate is within tolerance of the core fps and the speed factor that implies
+    bool GetDisplayLock(uint32_t& divisor, double& speed);
+    void InitAudio(double sample_rate);
     void CreateTexture(godot::Image::Format image_format, godot::PackedByteArray pixel_data, int32_t width, int32_t height, bool flip_y);
     void UpdateTexture(godot::PackedByteArray pixel_data, bool flip_y);
+    // Blocks while the ring is full unless the command can be dropped, false if it never got in
+    bool PushMainThreadCommand(MainThreadCommand&& command, bool droppable);
+    void DrainMainThreadCommands();
+    void SetCommandBudget(uint32_t budget_usec);
 
     bool Shutdown();
 
     static void LedInterfaceSetLedState(int32_t led, int32_t state);
 
 private:
-    Wrapper() = default;
     Wrapper(const Wrapper&) = delete;
     Wrapper& operator=(const Wrapper&) = delete;
     Wrapper(Wrapper&&) = delete;
     Wrapper& operator=(Wrapper&&) = delete;
 };
+
+// Binds the calling thread to one session while alive, so static callbacks and handlers reach it
+class SessionScope
+{
+public:
+    explicit SessionScope(Wrapper& wrapper);
+    ~SessionScope();
+
+    SessionScope(const SessionScope&) = delete;
+    SessionScope& operator=(const SessionScope&) = delete;
+
+private:
+    SessionContext* m_previous;
+};
 }